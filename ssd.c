@@ -13,6 +13,9 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
 
 
 /*
@@ -22,20 +25,116 @@
 #define TYPE_DIRECT 1
 #define TYPE_LOGGING 2
 #define TYPE_IDEAL 3
+#define TYPE_ZONED 4
 #define STATE_INVALID 1
 #define STATE_ERASED 2
 #define STATE_VALID 3
 
+// Write frontiers (open log blocks) of the logging FTL; host stream 0 writes
+// through FRONTIER_HOST and every other stream opens a frontier of its own
+#define MAX_STREAMS 4
+#define FRONTIER_HOST 0
+#define FRONTIER_SLC 1
+#define FRONTIER_GC 2
+#define MAX_FRONTIERS (FRONTIER_GC + MAX_STREAMS)
+#define FRONTIER_STREAM(n) ((n) == 0 ? FRONTIER_HOST : FRONTIER_GC + (n))
+
+// Temperature sketch: HEAT_DEPTH rows of counters indexed by hashed LBA region
+#define HEAT_DEPTH 2
+#define HEAT_WIDTH_BITS 8
+#define HEAT_WIDTH (1 << HEAT_WIDTH_BITS)
+
+// Zone states of the zoned (ZNS) device
+#define ZONE_EMPTY 0
+#define ZONE_IMPLICIT_OPEN 1
+#define ZONE_EXPLICIT_OPEN 2
+#define ZONE_CLOSED 3
+#define ZONE_FULL 4
+
+// Zone operation errors (negative, so appends can return a page instead)
+#define ZONE_ERR_BAD_ZONE -1
+#define ZONE_ERR_FULL -2
+#define ZONE_ERR_INVALID_WRITE -3
+#define ZONE_ERR_TOO_MANY_OPEN -4
+#define ZONE_ERR_NOT_OPEN -5
+
 
 // Maximum size
 #define MAX_PAGES 1000
 #define MAX_BLOCKS 100
+#define MAX_SHARDS 16
+#define MAX_PHASES 64
+
+// Bytes kept for one command's result string
+#define RESULT_SIZE 48
+
+// Entries per leaf of the sparse (two-level) maps
+#define MAP_LEAF_BITS 10
+#define MAP_LEAF_SIZE (1 << MAP_LEAF_BITS)
+
+// Slots in each shard's dispatch ring (power of two), and how many the
+// dispatcher fills before publishing them together
+#define RING_SIZE 256
+#define RING_BATCH 32
+
+// Map checkpoint entries (logical page, physical page) held by one flash page
+#define CHECKPOINT_ENTRIES_PER_PAGE 512
+
+
+/*
+    Statistics switch: build with -DSSD_STATS=0 to compile every counter
+    update out of the replay loops
+*/
+
+#ifndef SSD_STATS
+#define SSD_STATS 1
+#endif
+
+#if SSD_STATS
+#define STAT(x) (x)
+#else
+#define STAT(x) ((void)0)
+#endif
+
+
+/*
+    Profiling switch: build with -DSSD_PROFILE=1 to time the simulator's own
+    phases with clock_gettime and print a breakdown at exit
+*/
+
+#ifndef SSD_PROFILE
+#define SSD_PROFILE 0
+#endif
+
+// Host-side phases; a phase's time includes any phase nested inside it
+#define PROF_DISPATCH 0
+#define PROF_CURSOR 1
+#define PROF_GC 2
+#define PROF_GC_MIGRATE 3
+#define PROF_UPKEEP 4
+#define PROF_OUTPUT 5
+#define PROF_PHASES 6
+
+#if SSD_PROFILE
+#define PROF_BEGIN(s, p) ((s)->prof_start[p] = prof_now())
+#define PROF_END(s, p) ((s)->prof_ns[p] += prof_now() - (s)->prof_start[p], (s)->prof_calls[p]++)
+#else
+#define PROF_BEGIN(s, p) ((void)0)
+#define PROF_END(s, p) ((void)0)
+#endif
 
 
 /*
     SSD Structural Definition
 */
 
+// a run of consecutive host writes landing in the same region
+typedef struct {
+    int slc;
+    int host_writes;
+    float start_time;
+} PHASE;
+
 typedef struct {
     int ssd_type;
     int num_logical_pages;
@@ -52,8 +151,8 @@ typedef struct {
     int num_pages;
     int state[MAX_PAGES];
     char data[MAX_PAGES];
-    int current_page;
-    int current_block;
+    int current_page[MAX_FRONTIERS];
+    int current_block[MAX_FRONTIERS];
     int gc_count;
     int gc_current_block;
     int gc_used_blocks[MAX_BLOCKS];
@@ -61,6 +160,13 @@ typedef struct {
     int forward_map[MAX_PAGES];
     int reverse_map[MAX_PAGES];
 
+    // optional sparse maps: a directory of lazily allocated leaves
+    int sparse_map;
+    int **forward_leaves;
+    int **reverse_leaves;
+    int forward_leaf_count;
+    int reverse_leaf_count;
+
     int physical_erase_count[MAX_BLOCKS];
     int physical_read_count[MAX_BLOCKS];
     int physical_write_count[MAX_BLOCKS];
@@ -73,42 +179,349 @@ typedef struct {
     int logical_trim_fail_sum;
     int logical_write_fail_sum;
     int logical_read_fail_sum;
+
+    // internal relocation (GC, read-reclaim, SLC fold), kept apart from host traffic
+    float copyback_time;
+    int gc_read_sum;
+    int gc_write_sum;
+    int copyback_sum;
+    float copyback_time_sum;
+
+    // read disturb and retention (0 disables each)
+    int read_disturb_threshold;
+    float read_retry_time;
+    int retention_limit;
+    int op_clock;
+    int disturb_read_count[MAX_BLOCKS];
+    int program_stamp[MAX_BLOCKS];
+    int reclaim_pending[MAX_BLOCKS];
+    int reclaim_current_block;
+    int read_retry_sum;
+    int read_reclaim_sum;
+
+    // pseudo-SLC cache: blocks [0, slc_blocks) run in SLC mode
+    int slc_blocks;
+    float slc_erase_time;
+    float slc_program_time;
+    float slc_read_time;
+    int fold_current_block;
+    int fold_credit;
+    int host_idle;
+    int slc_write_sum;
+    int dense_write_sum;
+    int fold_page_sum;
+    int fold_block_sum;
+
+    // host write streams: a hint, or else the temperature classifier, picks the frontier
+    int write_stream;
+    char page_stream[MAX_PAGES];
+    int hot_threshold;
+    int heat_region_bits;
+    int heat_window;
+    int heat_writes;
+    unsigned short heat_sketch[HEAT_DEPTH][HEAT_WIDTH];
+    int stream_host_writes[MAX_STREAMS];
+    int stream_gc_writes[MAX_STREAMS];
+
+    // zoned namespace: zone z spans blocks [z * zone_blocks, (z + 1) * zone_blocks)
+    int zone_blocks;
+    int zone_pages;
+    int num_zones;
+    int max_open_zones;
+    int zone_state[MAX_BLOCKS];
+    int zone_wp[MAX_BLOCKS];
+    int host_zone;
+    int host_reclaim_zone;
+    int zone_reset_sum;
+    int zone_finish_sum;
+    int zone_invalid_write_sum;
+    int zone_open_fail_sum;
+    int host_reclaim_count;
+    int host_reclaim_read_sum;
+    int host_reclaim_write_sum;
+    char cmd_result[RESULT_SIZE];
+
+    // power-loss recovery: each programmed page's OOB holds its logical page
+    // (reverse_map) and a sequence number; the map may be checkpointed
+    int write_seq;
+    int oob_seq[MAX_PAGES];
+    int block_seq[MAX_BLOCKS];
+    int checkpoint_interval;
+    int checkpoint_seq;
+    int checkpoint_count;
+    int *checkpoint_lba;
+    int *checkpoint_page;
+    int checkpoint_sum;
+    int checkpoint_page_sum;
+    float checkpoint_time_sum;
+    int mount_channels;
+    int power_loss_sum;
+    int mount_blocks_scanned;
+    int mount_pages_read;
+    int mount_recovered;
+    int mount_stale;
+    int mount_lost;
+    int mount_resurrected;
+    float mount_time;
+    double mount_wall_ms;
+
+    // busy time, accumulated per operation since block timings differ
+    float erase_time_sum;
+    float write_time_sum;
+    float read_time_sum;
+    int num_phases;
+    int phase_slc;
+    float phase_start;
+    float region_time[2];
+    PHASE phases[MAX_PHASES];
+
+    // per-device buffer so concurrent shards never share a read result
+    char read_result[2];
+
+    // host-side profile, only updated in SSD_PROFILE builds
+    long prof_start[PROF_PHASES];
+    long prof_ns[PROF_PHASES];
+    long prof_calls[PROF_PHASES];
 } SSD;
 
+typedef struct {
+    int show_cmds;
+    int quiz_cmds;
+    int solve;
+    int show_state;
+} REPORT;
+
+
+/*
+    Sharded Simulation Structures
+
+    The device is split by channel into independent shards. Each shard owns
+    a contiguous range of blocks and the matching slice of the logical space,
+    and has its own write frontier, free pool and GC state (a full SSD).
+*/
+
+typedef struct {
+    int index;      // command number in reports
+    char op;        // 'r', 'w', 't', or 'q' to stop the worker
+    int address;    // logical address
+    char data;
+    int stream;     // write stream hint, -1 for none
+} OP;
+
+typedef struct {
+    OP slots[RING_SIZE];
+    _Alignas(64) atomic_uint head;   // next slot the worker consumes
+    unsigned int tail_seen;          // worker's last look at tail
+    _Alignas(64) atomic_uint tail;   // slots up to here are published to the worker
+    unsigned int fill;               // next slot the dispatcher fills
+    unsigned int head_seen;          // dispatcher's last look at head
+} RING;
+
+typedef struct {
+    SSD ssd;
+    RING ring;
+    int block_offset;
+    int lba_offset;
+    REPORT report;
+    FILE *out;      // command reports spooled until the run ends, NULL if none
+    pthread_t thread;
+} SHARD;
+
+/*
+    Mount Scan Structures
+
+    After a power loss each channel (a contiguous range of blocks) is scanned
+    by its own thread; the candidates are merged once all channels finish.
+*/
+
+typedef struct {
+    SSD *s;
+    int first_block;
+    int last_block;
+    int *pages;         // programmed after the checkpoint, in scan order
+    int page_count;
+    int blocks_scanned;
+    int pages_read;
+    float scan_time;
+    pthread_t thread;
+} SCAN;
+
+
+/*
+    Trace Source Structures
+
+    Commands are produced one at a time, generated from the -P/-K mix or
+    parsed from the -L list, so a trace never has to fit in memory. The
+    generator keeps the addresses written and not yet trimmed in the order
+    they were first written, with a Fenwick tree over the live slots. Picking
+    the i-th live address is O(log n) and yields the same commands as a plain
+    list would.
+
+    rand() takes a lock on every call once threads exist, so the generator
+    runs its own copy of glibc's default rand() (additive feedback over 31
+    words); a seed gives the same trace it always has.
+*/
+
+typedef struct {
+    char *list;             // -L list, consumed token by token; NULL when generating
+    char *list_next;
+    int cmd_total;          // commands in the trace, before any injected power loss
+    int cmds_left;
+    int crash_after;        // power loss injected after this many commands, 0 for none
+    int emitted;
+    int has_power_loss;
+
+    int max_page_addr;
+    int percent_reads;
+    int percent_writes;
+    int total_percent;
+    int read_fail;
+    int skew_writes;
+    int skew_space;
+    int skew_start;
+    int has_skew;
+    unsigned int rng[34];
+    int rng_next;
+
+    int *slots;             // address per slot in first-write order, -1 once trimmed
+    int *live_tree;         // Fenwick tree counting live slots
+    int slot_count;
+    int slot_cap;
+    int live_count;
+    int **written_leaves;   // 1 for each address held in a live slot
+    int written_leaf_count;
+} TRACE;
+
+
+/*
+    FTL Policy Interface
+
+    Each FTL type supplies its write and upkeep policy to DEFINE_FTL, which
+    generates a replay loop and a shard worker specialised for that type.
+    The type is resolved once per run; the per-op path has no dispatch.
+*/
+
+typedef struct {
+    int type;
+    const char *name;
+    void (*replay)(SSD *s, TRACE *t, REPORT *r);
+    void *(*shard_worker)(void *arg);
+} FTL;
+
 
 /* 
     Implicit Function declaration 
 */
 
 int blocks_in_use(SSD *s);
+int free_blocks(SSD *s);
+int gc_reserve(SSD *s);
 void physical_erase(SSD *s, int block_address);
 void physical_program(SSD *s, int page_address, char data);
 char physical_read(SSD *s, int page_address);
 char *read_direct(SSD *s, int address);
 char *write_direct(SSD *s, int page_address, char data);
 char *write_ideal(SSD *s, int page_address, char data);
-int is_block_free(SSD *s, int block);
-int get_cursor(SSD *s);
-void update_cursor(SSD *s);
+int is_block_free(SSD *s, int block, int frontier);
+int is_open_block(SSD *s, int block);
+int is_filling_block(SSD *s, int block);
+int find_free_block(SSD *s, int frontier, int lo, int hi);
+int get_cursor(SSD *s, int frontier);
+void update_cursor(SSD *s, int frontier);
+float busy_time(SSD *s);
+void record_phase(SSD *s, int slc);
+int slc_free_blocks(SSD *s);
+void fold_slc(SSD *s);
 char *write_logging(SSD *s, int page_address, char data, int is_gc_write);
+int collect_live_pages(SSD *s, int block, int *live_pages);
+void physical_copyback(SSD *s, int src_page, int dst_page);
+int relocate_page(SSD *s, int frontier, const char *tag, int count, int page);
+int migrate_live_pages(SSD *s, int frontier, const char *tag, int count, int *live_pages, int live_count);
 void garbage_collect(SSD *s);
+void check_read_disturb(SSD *s, int block);
+void read_reclaim(SSD *s);
 void upkeep(SSD *s);
 char *trim(SSD *s, int address);
 char *read_ssd(SSD *s, int address);
-char *write_ssd(SSD *s, int address, char data);
 char printable_state(int s);
 void stats(SSD *s);
 void dump(SSD *s);
+void upkeep_none(SSD *s);
+char *write_log(SSD *s, int page_address, char data);
+const FTL *ftl_by_type(int type);
+const FTL *ftl_by_name(const char *name);
+int parse_cmd(char *cmd, OP *op);
+void report_cmd(FILE *out, int op_num, OP *op, char *rc, REPORT *r);
+void initialize_trace(TRACE *t, int seed, char *cmd_list, const char *op_percentages,
+                      const char *skew, int skew_start, int read_fail, int num_cmds,
+                      int num_logical_pages);
+void free_trace(TRACE *t);
+void seed_trace(TRACE *t, int seed);
+int trace_rand(TRACE *t);
+void rebuild_live_tree(TRACE *t);
+void add_written_address(TRACE *t, int address);
+int find_live_slot(TRACE *t, int k);
+void remove_live_slot(TRACE *t, int slot);
+void generate_op(TRACE *t, OP *op);
+int next_op(TRACE *t, OP *op);
+void ring_publish(RING *r);
+void ring_push(RING *r, OP *op);
+void ring_pop(RING *r, OP *op);
+void merge_shards(SSD *s, SHARD *shards, int num_shards);
+int shard_address(SHARD *sh, int address);
+void run_sharded(SSD *s, TRACE *t, int num_shards, REPORT *r);
 void initialize_ssd (SSD *s, int ssd_type, int num_logical_pages, int num_blocks,
                     int pages_per_block, float block_erase_time, float page_program_time,
                     float page_read_time, int high_water_mark, int low_water_mark,
                     int trace_gc, int show_state);
+void configure_read_disturb(SSD *s, int threshold, float retry_time, int retention_limit);
+void configure_slc(SSD *s, int slc_blocks, float erase_time, float program_time, float read_time);
+void configure_copyback(SSD *s, float copyback_time);
+void configure_zones(SSD *s, int zone_blocks, int max_open_zones);
+void configure_streams(SSD *s, int hot_threshold, int region_bits);
+int classify_write(SSD *s, int logical_page);
+void configure_sparse_map(SSD *s);
+void free_sparse_map(SSD *s);
+long map_directory_size(long entries);
+int *map_leaf(int **leaves, int *leaf_count, int key);
+int fmap_next(SSD *s, int logical_page);
+int zone_open_count(SSD *s);
+int zone_acquire(SSD *s, int zone, int explicit_open);
+int zone_program(SSD *s, int zone, char data);
+int zone_write(SSD *s, int page_address, char data);
+int zone_append(SSD *s, int zone, char data);
+int zone_reset(SSD *s, int zone);
+int zone_finish(SSD *s, int zone);
+int zone_open(SSD *s, int zone);
+int zone_close(SSD *s, int zone);
+char *zone_error(int rc);
+char printable_zone_state(int state);
+char *zone_cmd(SSD *s, OP *op);
+int host_zone_append(SSD *s, int *zone, char data);
+char *write_zoned(SSD *s, int page_address, char data);
+int empty_zones(SSD *s);
+void host_zone_reclaim(SSD *s);
+void upkeep_zoned(SSD *s);
+void profile_report(SSD *s, long wall_ns);
+void configure_recovery(SSD *s, int checkpoint_interval, int mount_channels);
+void free_checkpoint(SSD *s);
+int checkpoint_map_pages(int count);
+void checkpoint_map(SSD *s);
+void *scan_channel(void *arg);
+void mount_ssd(SSD *s);
+char *power_loss(SSD *s);
 
 
 /*
     Implementation of Functions
 */
 
+static inline long prof_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
 void initialize_ssd(SSD *s, int ssd_type, int num_logical_pages, int num_blocks, int pages_per_block,
                     float block_erase_time, float page_program_time, float page_read_time,
                     int high_water_mark, int low_water_mark, int trace_gc, int show_state) {
@@ -130,8 +543,12 @@ void initialize_ssd(SSD *s, int ssd_type, int num_logical_pages, int num_blocks,
         s->data[i] = ' ';
     }
 
-    s->current_page = -1;
-    s->current_block = 0;
+    // only the host frontier is open until another one is configured
+    for (int f = 0; f < MAX_FRONTIERS; f++) {
+        s->current_page[f] = -1;
+        s->current_block[f] = -1;
+    }
+    s->current_block[FRONTIER_HOST] = 0;
 
     // gc counts
     s->gc_count = 0;
@@ -149,12 +566,105 @@ void initialize_ssd(SSD *s, int ssd_type, int num_logical_pages, int num_blocks,
         s->physical_erase_count[i] = 0;
         s->physical_read_count[i] = 0;
         s->physical_write_count[i] = 0;
+
+        // read disturb / retention tracking
+        s->disturb_read_count[i] = 0;
+        s->program_stamp[i] = -1;
+        s->reclaim_pending[i] = 0;
+
+        // newest sequence number programmed into the block
+        s->block_seq[i] = 0;
     }
 
+    // read disturb and retention modelling is off unless configured
+    s->read_disturb_threshold = 0;
+    s->read_retry_time = 0;
+    s->retention_limit = 0;
+    s->op_clock = 0;
+    s->reclaim_current_block = 0;
+    s->read_retry_sum = 0;
+    s->read_reclaim_sum = 0;
+
+    // no pSLC region unless configured
+    s->slc_blocks = 0;
+    s->slc_erase_time = block_erase_time;
+    s->slc_program_time = page_program_time;
+    s->slc_read_time = page_read_time;
+    s->fold_current_block = 0;
+    s->fold_credit = 0;
+    s->host_idle = 0;
+    s->slc_write_sum = 0;
+    s->dense_write_sum = 0;
+    s->fold_page_sum = 0;
+    s->fold_block_sum = 0;
+
+    // one stream and no classifier unless configured
+    s->write_stream = -1;
+    s->hot_threshold = 0;
+    s->heat_region_bits = 0;
+    s->heat_window = 0;
+    s->heat_writes = 0;
+    memset(s->heat_sketch, 0, sizeof(s->heat_sketch));
+    for (int i = 0; i < MAX_STREAMS; i++) {
+        s->stream_host_writes[i] = 0;
+        s->stream_gc_writes[i] = 0;
+    }
+
+    // not zoned unless configured
+    s->zone_blocks = 0;
+    s->zone_pages = 0;
+    s->num_zones = 0;
+    s->max_open_zones = 0;
+    s->host_zone = -1;
+    s->host_reclaim_zone = -1;
+    s->zone_reset_sum = 0;
+    s->zone_finish_sum = 0;
+    s->zone_invalid_write_sum = 0;
+    s->zone_open_fail_sum = 0;
+    s->host_reclaim_count = 0;
+    s->host_reclaim_read_sum = 0;
+    s->host_reclaim_write_sum = 0;
+
+    // no checkpoints and a single mount channel unless configured
+    s->write_seq = 0;
+    s->checkpoint_interval = 0;
+    s->checkpoint_seq = 0;
+    s->checkpoint_count = 0;
+    s->checkpoint_lba = NULL;
+    s->checkpoint_page = NULL;
+    s->checkpoint_sum = 0;
+    s->checkpoint_page_sum = 0;
+    s->checkpoint_time_sum = 0;
+    s->mount_channels = 1;
+    s->power_loss_sum = 0;
+    s->mount_blocks_scanned = 0;
+    s->mount_pages_read = 0;
+    s->mount_recovered = 0;
+    s->mount_stale = 0;
+    s->mount_lost = 0;
+    s->mount_resurrected = 0;
+    s->mount_time = 0;
+    s->mount_wall_ms = 0;
+
+    s->erase_time_sum = 0;
+    s->write_time_sum = 0;
+    s->read_time_sum = 0;
+    s->num_phases = 0;
+    s->phase_slc = 0;
+    s->phase_start = 0;
+    s->region_time[0] = 0;
+    s->region_time[1] = 0;
+
     s->physical_erase_sum = 0;
     s->physical_write_sum = 0;
     s->physical_read_sum = 0;
 
+    for (int i = 0; i < PROF_PHASES; i++) {
+        s->prof_start[i] = 0;
+        s->prof_ns[i] = 0;
+        s->prof_calls[i] = 0;
+    }
+
     s->logical_trim_sum = 0;
     s->logical_write_sum = 0;
     s->logical_read_sum = 0;
@@ -163,13 +673,200 @@ void initialize_ssd(SSD *s, int ssd_type, int num_logical_pages, int num_blocks,
     s->logical_write_fail_sum = 0;
     s->logical_read_fail_sum = 0;
 
-    for (int i = 0; i < s->num_logical_pages; i++) {
+    // relocations read out through the controller unless copyback is configured
+    s->copyback_time = 0;
+    s->gc_read_sum = 0;
+    s->gc_write_sum = 0;
+    s->copyback_sum = 0;
+    s->copyback_time_sum = 0;
+
+    // dense maps; a logical space beyond MAX_PAGES needs configure_sparse_map()
+    s->sparse_map = 0;
+    s->forward_leaves = NULL;
+    s->reverse_leaves = NULL;
+    s->forward_leaf_count = 0;
+    s->reverse_leaf_count = 0;
+    for (int i = 0; i < s->num_logical_pages && i < MAX_PAGES; i++) {
         s->forward_map[i] = -1;
     }
 
     for (int i = 0; i < s->num_pages; i++) {
         s->reverse_map[i] = -1;
+        s->oob_seq[i] = 0;
+        s->page_stream[i] = 0;
+    }
+}
+
+void configure_read_disturb(SSD *s, int threshold, float retry_time, int retention_limit) {
+    s->read_disturb_threshold = threshold;
+    s->read_retry_time = retry_time;
+    s->retention_limit = retention_limit;
+}
+
+void configure_slc(SSD *s, int slc_blocks, float erase_time, float program_time, float read_time) {
+    s->slc_blocks = slc_blocks;
+    s->slc_erase_time = erase_time;
+    s->slc_program_time = program_time;
+    s->slc_read_time = read_time;
+    if (slc_blocks > 0) {
+        s->current_block[FRONTIER_SLC] = 0;
+        s->current_block[FRONTIER_HOST] = slc_blocks;
+    }
+}
+
+void configure_copyback(SSD *s, float copyback_time) {
+    s->copyback_time = copyback_time;
+}
+
+void configure_zones(SSD *s, int zone_blocks, int max_open_zones) {
+    s->zone_blocks = zone_blocks;
+    s->zone_pages = zone_blocks * s->pages_per_block;
+    s->num_zones = s->num_blocks / zone_blocks;
+    s->max_open_zones = max_open_zones;
+    for (int z = 0; z < s->num_zones; z++) {
+        s->zone_state[z] = ZONE_EMPTY;
+        s->zone_wp[z] = z * s->zone_pages;
+    }
+}
+
+void configure_streams(SSD *s, int hot_threshold, int region_bits) {
+    s->hot_threshold = hot_threshold;
+    s->heat_region_bits = region_bits;
+
+    // counters halve once per device's worth of writes
+    s->heat_window = s->num_pages;
+}
+
+void configure_recovery(SSD *s, int checkpoint_interval, int mount_channels) {
+    s->checkpoint_interval = checkpoint_interval;
+    s->mount_channels = mount_channels;
+}
+
+void free_checkpoint(SSD *s) {
+    free(s->checkpoint_lba);
+    free(s->checkpoint_page);
+    s->checkpoint_lba = NULL;
+    s->checkpoint_page = NULL;
+}
+
+void configure_sparse_map(SSD *s) {
+    s->sparse_map = 1;
+    s->forward_leaves = calloc(map_directory_size(s->num_logical_pages), sizeof(int *));
+    s->reverse_leaves = calloc(map_directory_size(s->num_pages), sizeof(int *));
+    if (s->forward_leaves == NULL || s->reverse_leaves == NULL) {
+        printf("out of memory for sparse map directory\n");
+        exit(1);
+    }
+}
+
+void free_sparse_map(SSD *s) {
+    if (!s->sparse_map) {
+        return;
+    }
+    for (long i = 0; i < map_directory_size(s->num_logical_pages); i++) {
+        free(s->forward_leaves[i]);
+    }
+    for (long i = 0; i < map_directory_size(s->num_pages); i++) {
+        free(s->reverse_leaves[i]);
+    }
+    free(s->forward_leaves);
+    free(s->reverse_leaves);
+    s->sparse_map = 0;
+}
+
+// leaves needed to cover the given entries; in long, as -l can be close to INT_MAX
+long map_directory_size(long entries) {
+    return (entries + MAP_LEAF_SIZE - 1) / MAP_LEAF_SIZE;
+}
+
+int *map_leaf(int **leaves, int *leaf_count, int key) {
+    int **slot = &leaves[key >> MAP_LEAF_BITS];
+    if (*slot == NULL) {
+        *slot = malloc(MAP_LEAF_SIZE * sizeof(int));
+        if (*slot == NULL) {
+            printf("out of memory for map leaf\n");
+            exit(1);
+        }
+
+        // all bits set is -1, i.e. unmapped
+        memset(*slot, 0xff, MAP_LEAF_SIZE * sizeof(int));
+        (*leaf_count)++;
+    }
+    return *slot;
+}
+
+static inline int fmap_get(SSD *s, int logical_page) {
+    if (s->sparse_map) {
+        int *leaf = s->forward_leaves[logical_page >> MAP_LEAF_BITS];
+        return (leaf == NULL) ? -1 : leaf[logical_page & (MAP_LEAF_SIZE - 1)];
+    }
+    return s->forward_map[logical_page];
+}
+
+static inline void fmap_set(SSD *s, int logical_page, int page) {
+    if (s->sparse_map) {
+
+        // unmapping never needs a leaf
+        if (page == -1 && s->forward_leaves[logical_page >> MAP_LEAF_BITS] == NULL) {
+            return;
+        }
+        map_leaf(s->forward_leaves, &s->forward_leaf_count, logical_page)[logical_page & (MAP_LEAF_SIZE - 1)] = page;
+        return;
+    }
+    s->forward_map[logical_page] = page;
+}
+
+static inline int rmap_get(SSD *s, int page) {
+    if (s->sparse_map) {
+        int *leaf = s->reverse_leaves[page >> MAP_LEAF_BITS];
+        return (leaf == NULL) ? -1 : leaf[page & (MAP_LEAF_SIZE - 1)];
+    }
+    return s->reverse_map[page];
+}
+
+static inline void rmap_set(SSD *s, int page, int logical_page) {
+    if (s->sparse_map) {
+        if (logical_page == -1 && s->reverse_leaves[page >> MAP_LEAF_BITS] == NULL) {
+            return;
+        }
+        map_leaf(s->reverse_leaves, &s->reverse_leaf_count, page)[page & (MAP_LEAF_SIZE - 1)] = logical_page;
+        return;
+    }
+    s->reverse_map[page] = logical_page;
+}
+
+int fmap_next(SSD *s, int logical_page) {
+    while (logical_page < s->num_logical_pages) {
+
+        // skip whole unallocated leaves
+        if (s->sparse_map && s->forward_leaves[logical_page >> MAP_LEAF_BITS] == NULL) {
+            long next = ((long)(logical_page >> MAP_LEAF_BITS) + 1) << MAP_LEAF_BITS;
+            if (next >= s->num_logical_pages) {
+                return -1;
+            }
+            logical_page = (int)next;
+            continue;
+        }
+        if (fmap_get(s, logical_page) != -1) {
+            return logical_page;
+        }
+        logical_page++;
+    }
+    return -1;
+}
+
+int free_blocks(SSD *s) {
+    int free_count = 0;
+    for (int i = 0; i < s->num_blocks; i++) {
+        free_count += !s->gc_used_blocks[i];
     }
+    return free_count;
+}
+
+// blocks held back from host writes so GC always has somewhere to relocate into;
+// none when the high water mark is out of reach, since GC then never runs
+int gc_reserve(SSD *s) {
+    return s->gc_high_water_mark <= s->num_blocks && s->current_page[FRONTIER_GC] == -1;
 }
 
 int blocks_in_use(SSD *s) {
@@ -177,6 +874,11 @@ int blocks_in_use(SSD *s) {
     for (int i = 0; i < s->num_blocks; i++) {
         used += s->gc_used_blocks[i];
     }
+
+    // the GC frontier's open block is relocation headroom, not host data
+    if (s->current_page[FRONTIER_GC] != -1) {
+        used--;
+    }
     return used;
 }
 
@@ -187,38 +889,59 @@ void physical_erase(SSD *s, int block_address) {
     for (int page = page_begin; page <= page_end; page++) {
         s->data[page] = ' ';
         s->state[page] = STATE_ERASED;
+        s->oob_seq[page] = 0;
     }
+    s->block_seq[block_address] = 0;
 
     // definitely NOT in use
     s->gc_used_blocks[block_address] = 0;
 
+    // fresh cells: no disturb, no retention age
+    s->disturb_read_count[block_address] = 0;
+    s->program_stamp[block_address] = -1;
+    s->reclaim_pending[block_address] = 0;
+
     // stats
-    s->physical_erase_count[block_address]++;
-    s->physical_erase_sum++;
+    STAT(s->physical_erase_count[block_address]++);
+    STAT(s->physical_erase_sum++);
+    STAT(s->erase_time_sum += (block_address < s->slc_blocks) ? s->slc_erase_time : s->block_erase_time);
 }
 
 void physical_program(SSD *s, int page_address, char data) {
     s->data[page_address] = data;
     s->state[page_address] = STATE_VALID;
+    s->oob_seq[page_address] = ++s->write_seq;
+    s->block_seq[page_address / s->pages_per_block] = s->write_seq;
+
+    // retention age runs from the oldest data in the block
+    if (s->retention_limit > 0 && s->program_stamp[page_address / s->pages_per_block] == -1) {
+        s->program_stamp[page_address / s->pages_per_block] = s->op_clock;
+    }
 
     // stats
-    s->physical_write_count[page_address / s->pages_per_block]++;
-    s->physical_write_sum++;
+    STAT(s->physical_write_count[page_address / s->pages_per_block]++);
+    STAT(s->physical_write_sum++);
+    STAT(s->write_time_sum += (page_address / s->pages_per_block < s->slc_blocks) ?
+                              s->slc_program_time : s->page_program_time);
 }
 
 char physical_read(SSD *s, int page_address) {
+    if (s->read_disturb_threshold > 0 || s->retention_limit > 0) {
+        check_read_disturb(s, page_address / s->pages_per_block);
+    }
 
     // stats
-    s->physical_read_count[page_address / s->pages_per_block]++;
-    s->physical_read_sum++;
+    STAT(s->physical_read_count[page_address / s->pages_per_block]++);
+    STAT(s->physical_read_sum++);
+    STAT(s->read_time_sum += (page_address / s->pages_per_block < s->slc_blocks) ?
+                             s->slc_read_time : s->page_read_time);
     return s->data[page_address];
 }
 
 char *read_direct(SSD *s, int address) {
-    static char result[2];
-    result[0] = physical_read(s, address);
-    result[1] = '\0';
-    return result;
+    s->read_result[0] = physical_read(s, address);
+    s->read_result[1] = '\0';
+    return s->read_result;
 }
 
 char *write_direct(SSD *s, int page_address, char data) {
@@ -250,70 +973,290 @@ char *write_direct(SSD *s, int page_address, char data) {
     }
 
     physical_program(s, page_address, data);
-    s->forward_map[page_address] = page_address;
-    s->reverse_map[page_address] = page_address;
+    fmap_set(s, page_address, page_address);
+    rmap_set(s, page_address, page_address);
     return "success";
 }
 
 char *write_ideal(SSD *s, int page_address, char data) {
     physical_program(s, page_address, data);
-    s->forward_map[page_address] = page_address;
-    s->reverse_map[page_address] = page_address;
+    fmap_set(s, page_address, page_address);
+    rmap_set(s, page_address, page_address);
     return "success";
 }
 
-int is_block_free(SSD *s, int block) {
+int is_block_free(SSD *s, int block, int frontier) {
     int first_page = block * s->pages_per_block;
     if (s->state[first_page] == STATE_INVALID || s->state[first_page] == STATE_ERASED) {
         if (s->state[first_page] == STATE_INVALID) {
             physical_erase(s, block);
         }
-        s->current_block = block;
-        s->current_page = first_page;
+        s->current_block[frontier] = block;
+        s->current_page[frontier] = first_page;
         s->gc_used_blocks[block] = 1;
         return 1;
     }
     return 0;
 }
 
-int get_cursor(SSD *s) {
-    if (s->current_page == -1) {
-        for (int block = s->current_block; block < s->num_blocks; block++) {
-            if (is_block_free(s, block)) {
-                return 0;
-            }
+int is_open_block(SSD *s, int block) {
+    for (int f = 0; f < MAX_FRONTIERS; f++) {
+        if (s->current_block[f] == block) {
+            return 1;
         }
-        for (int block = 0; block < s->current_block; block++) {
-            if (is_block_free(s, block)) {
-                return 0;
-            }
+    }
+    return 0;
+}
+
+int is_filling_block(SSD *s, int block) {
+    for (int f = 0; f < MAX_FRONTIERS; f++) {
+        if (s->current_block[f] == block && s->current_page[f] != -1) {
+            return 1;
         }
-        return -1;
     }
     return 0;
 }
 
-void update_cursor(SSD *s) {
-    s->current_page++;
-    if (s->current_page % s->pages_per_block == 0) {
-        s->current_page = -1;
+int find_free_block(SSD *s, int frontier, int lo, int hi) {
+    int start = s->current_block[frontier];
+    if (start < lo || start >= hi) {
+        start = lo;
+    }
+    for (int block = start; block < hi; block++) {
+        if (is_block_free(s, block, frontier)) {
+            return 0;
+        }
+    }
+    for (int block = lo; block < start; block++) {
+        if (is_block_free(s, block, frontier)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int get_cursor(SSD *s, int frontier) {
+    int rc = 0;
+    PROF_BEGIN(s, PROF_CURSOR);
+    if (s->current_page[frontier] == -1) {
+
+        if (frontier != FRONTIER_GC && free_blocks(s) <= gc_reserve(s)) {
+            rc = -1;
+        } else if (frontier == FRONTIER_SLC) {
+
+            // the SLC frontier lives in the pSLC region, every other one outside it
+            rc = find_free_block(s, frontier, 0, s->slc_blocks);
+        } else if (find_free_block(s, frontier, s->slc_blocks, s->num_blocks) == 0) {
+            rc = 0;
+        } else if (frontier == FRONTIER_GC) {
+
+            // relocations may spill into the cache rather than stall GC
+            rc = find_free_block(s, frontier, 0, s->slc_blocks);
+        } else {
+            rc = -1;
+        }
+    }
+    PROF_END(s, PROF_CURSOR);
+    return rc;
+}
+
+void update_cursor(SSD *s, int frontier) {
+    s->current_page[frontier]++;
+    if (s->current_page[frontier] % s->pages_per_block == 0) {
+        s->current_page[frontier] = -1;
+    }
+}
+
+float busy_time(SSD *s) {
+    return s->erase_time_sum + s->write_time_sum + s->read_time_sum +
+           s->read_retry_sum * s->read_retry_time + s->copyback_time_sum + s->checkpoint_time_sum;
+}
+
+void record_phase(SSD *s, int slc) {
+    if (s->num_phases == 0 || s->phase_slc != slc) {
+        float now = busy_time(s);
+        if (s->num_phases > 0) {
+            s->region_time[s->phase_slc] += now - s->phase_start;
+        }
+
+        // only the first MAX_PHASES are kept for the timeline; totals cover all
+        if (s->num_phases < MAX_PHASES) {
+            s->phases[s->num_phases].slc = slc;
+            s->phases[s->num_phases].host_writes = 0;
+            s->phases[s->num_phases].start_time = now;
+        }
+        s->num_phases++;
+        s->phase_slc = slc;
+        s->phase_start = now;
+    }
+    if (s->num_phases <= MAX_PHASES) {
+        s->phases[s->num_phases - 1].host_writes++;
+    }
+}
+
+int classify_write(SSD *s, int logical_page) {
+    static const unsigned int seeds[HEAT_DEPTH] = { 0x9e3779b1u, 0x85ebca6bu };
+    unsigned int region = (unsigned int)logical_page >> s->heat_region_bits;
+
+    // count-min: the smallest of the region's counters bounds its write count
+    int estimate = 0xffff;
+    for (int row = 0; row < HEAT_DEPTH; row++) {
+        unsigned short *counter = &s->heat_sketch[row][(region * seeds[row]) >> (32 - HEAT_WIDTH_BITS)];
+        if (*counter < 0xffff) {
+            (*counter)++;
+        }
+        if (*counter < estimate) {
+            estimate = *counter;
+        }
+    }
+
+    // halving ages out old writes, so the estimate favours recent updates
+    if (++s->heat_writes >= s->heat_window) {
+        for (int row = 0; row < HEAT_DEPTH; row++) {
+            for (int i = 0; i < HEAT_WIDTH; i++) {
+                s->heat_sketch[row][i] >>= 1;
+            }
+        }
+        s->heat_writes = 0;
     }
+
+    // hot data goes to stream 1, cold data stays in stream 0
+    return estimate >= s->hot_threshold;
 }
 
 char *write_logging(SSD *s, int page_address, char data, int is_gc_write) {
-    if (get_cursor(s) == -1) {
-        s->logical_write_fail_sum++;
+
+    // a host hint wins over the classifier
+    int stream = 0;
+    if (!is_gc_write) {
+        if (s->write_stream >= 0) {
+            stream = s->write_stream;
+        } else if (s->hot_threshold > 0) {
+            stream = classify_write(s, page_address);
+        }
+    }
+
+    // host writes are absorbed by the pSLC cache while it has room
+    int frontier = FRONTIER_STREAM(stream);
+    if (s->slc_blocks > 0 && !is_gc_write && get_cursor(s, FRONTIER_SLC) == 0) {
+        frontier = FRONTIER_SLC;
+    }
+    if (get_cursor(s, frontier) == -1) {
+        STAT(s->logical_write_fail_sum++);
         return "failure: device full";
     }
+    if (s->slc_blocks > 0 && !is_gc_write) {
+        if (frontier == FRONTIER_SLC) {
+            STAT(s->slc_write_sum++);
+        } else {
+            STAT(s->dense_write_sum++);
+            s->fold_credit++;
+        }
+        STAT(record_phase(s, frontier == FRONTIER_SLC));
+    }
 
     // normal mode writing
-    physical_program(s, s->current_page, data);
-    s->forward_map[page_address] = s->current_page;
-    s->reverse_map[s->current_page] = page_address;
-    update_cursor(s);
+    int page = s->current_page[frontier];
+    physical_program(s, page, data);
+    fmap_set(s, page_address, page);
+    rmap_set(s, page, page_address);
+    s->page_stream[page] = stream;
+    if (!is_gc_write) {
+        STAT(s->stream_host_writes[stream]++);
+    }
+    update_cursor(s, frontier);
     return "success";
 }
 
+char *write_log(SSD *s, int page_address, char data) {
+    return write_logging(s, page_address, data, 0);
+}
+
+int collect_live_pages(SSD *s, int block, int *live_pages) {
+    int page_start = block * s->pages_per_block;
+    int live_count = 0;
+    for (int page = page_start; page < page_start + s->pages_per_block; page++) {
+        int logical_page = rmap_get(s, page);
+        if (logical_page != -1 && fmap_get(s, logical_page) == page) {
+            live_pages[live_count++] = page;
+        }
+    }
+    return live_count;
+}
+
+void physical_copyback(SSD *s, int src_page, int dst_page) {
+    int src_block = src_page / s->pages_per_block;
+    int dst_block = dst_page / s->pages_per_block;
+    if (s->read_disturb_threshold > 0 || s->retention_limit > 0) {
+        check_read_disturb(s, src_block);
+    }
+
+    // on-die move: sensed and reprogrammed without crossing the channel
+    s->data[dst_page] = s->data[src_page];
+    s->state[dst_page] = STATE_VALID;
+    s->oob_seq[dst_page] = ++s->write_seq;
+    s->block_seq[dst_block] = s->write_seq;
+    if (s->retention_limit > 0 && s->program_stamp[dst_block] == -1) {
+        s->program_stamp[dst_block] = s->op_clock;
+    }
+
+    // stats
+    STAT(s->physical_read_count[src_block]++);
+    STAT(s->physical_write_count[dst_block]++);
+    STAT(s->physical_read_sum++);
+    STAT(s->physical_write_sum++);
+    STAT(s->copyback_sum++);
+    STAT(s->copyback_time_sum += s->copyback_time);
+}
+
+int relocate_page(SSD *s, int frontier, const char *tag, int count, int page) {
+
+    // with no block left to open, relocate into the host's open block instead
+    if (get_cursor(s, frontier) == -1) {
+        frontier = FRONTIER_HOST;
+        if (get_cursor(s, frontier) == -1) {
+            return -1;
+        }
+    }
+
+    int new_page = s->current_page[frontier];
+    int logical_page = rmap_get(s, page);
+    if (s->copyback_time > 0) {
+        if (s->gc_trace) {
+            printf("%s %d:: copyback(physical_page=%d)\n", tag, count, page);
+        }
+        physical_copyback(s, page, new_page);
+    } else {
+        if (s->gc_trace) {
+            printf("%s %d:: read(physical_page=%d)\n", tag, count, page);
+            printf("%s %d:: write()\n", tag, count);
+        }
+        physical_program(s, new_page, physical_read(s, page));
+        STAT(s->gc_read_sum++);
+    }
+    STAT(s->gc_write_sum++);
+
+    // relocated data stays charged to the stream that wrote it
+    s->page_stream[new_page] = s->page_stream[page];
+    STAT(s->stream_gc_writes[(int)s->page_stream[page]]++);
+
+    fmap_set(s, logical_page, new_page);
+    rmap_set(s, new_page, logical_page);
+    update_cursor(s, frontier);
+    return 0;
+}
+
+int migrate_live_pages(SSD *s, int frontier, const char *tag, int count, int *live_pages, int live_count) {
+
+    // live pages are relocated into the given frontier, never through the host write path
+    for (int i = 0; i < live_count; i++) {
+        if (relocate_page(s, frontier, tag, count, live_pages[i]) == -1) {
+            return i;
+        }
+    }
+    return live_count;
+}
+
 void garbage_collect(SSD *s) {
 
     int blocks_cleaned = 0;
@@ -321,8 +1264,8 @@ void garbage_collect(SSD *s) {
     for (int i = 0; i < s->num_blocks; i++) {
         int block = (s->gc_current_block + i) % s->num_blocks;
 
-        // don't GC the block currently being written to
-        if (block == s->current_block) {
+        // don't GC a block currently being written to
+        if (is_filling_block(s, block)) {
             continue;
         }
 
@@ -336,30 +1279,22 @@ void garbage_collect(SSD *s) {
 
         // collect list of live physical pages in this block
         int live_pages[MAX_PAGES];
-        int live_count = 0;
-        for (int page = page_start; page < page_start + s->pages_per_block; page++) {
-            int logical_page = s->reverse_map[page];
-            if (logical_page != -1 && s->forward_map[logical_page] == page) {
-                live_pages[live_count++] = page;
-            }
-        }
+        int live_count = collect_live_pages(s, block, live_pages);
 
         // if only live blocks, then don't clean it
         if (live_count == s->pages_per_block) {
             continue;
         }
 
-        // live pages should be copied to current writing location
-        for (int i = 0; i < live_count; i++) {
-            int page = live_pages[i];
+        // live pages should be copied to the GC writing location
+        PROF_BEGIN(s, PROF_GC_MIGRATE);
+        int moved = migrate_live_pages(s, FRONTIER_GC, "gc", s->gc_count, live_pages, live_count);
+        PROF_END(s, PROF_GC_MIGRATE);
+        if (moved < live_count) {
 
-            // live, so copy it someplace new
-            if (s->gc_trace) {
-                printf("gc %d:: read(physical_page=%d)\n", s->gc_count, page);
-                printf("gc %d:: write()\n", s->gc_count);
-            }
-            char data = physical_read(s, page);
-            write_ssd(s, s->reverse_map[page], data);
+            // no room left to relocate into; the victim keeps what was not moved,
+            // but blocks with nothing live can still be erased
+            continue;
         }
 
         // finally, erase the block and see if we're done
@@ -387,60 +1322,672 @@ void garbage_collect(SSD *s) {
     // END: block iteration
 }
 
-void upkeep(SSD *s) {
+void check_read_disturb(SSD *s, int block) {
+    s->disturb_read_count[block]++;
 
-    // GARBAGE COLLECTION
-    if (blocks_in_use(s) >= s->gc_high_water_mark) {
-        garbage_collect(s);
-    }
-    // WEAR LEVELING: for future
-}
+    int disturbed = s->read_disturb_threshold > 0 &&
+                    s->disturb_read_count[block] > s->read_disturb_threshold;
+    int aged = s->retention_limit > 0 && s->program_stamp[block] != -1 &&
+               s->op_clock - s->program_stamp[block] > s->retention_limit;
 
-char *trim(SSD *s, int address) {
-    s->logical_trim_sum++;
-    if (address < 0 || address >= s->num_logical_pages) {
-        s->logical_trim_fail_sum++;
-        return "fail: illegal trim address";
+    // marginal cells: this read needs retries, and the block should be refreshed
+    if (disturbed || aged) {
+        STAT(s->read_retry_sum++);
+        s->reclaim_pending[block] = 1;
     }
-    if (s->forward_map[address] == -1) {
-        s->logical_trim_fail_sum++;
-        return "fail: uninitialized trim";
-    }
-    s->forward_map[address] = -1;
-    return "success";
 }
 
-char *read_ssd(SSD *s, int address) {
-    s->logical_read_sum++;
-    if (address < 0 || address >= s->num_logical_pages) {
-        s->logical_read_fail_sum++;
-        return "fail: illegal read address";
-    }
-    if (s->forward_map[address] == -1) {
-        s->logical_read_fail_sum++;
-        return "fail: uninitialized read";
-    }
+void read_reclaim(SSD *s) {
 
-    // USED for DIRECT and LOGGING and IDEAL
-    return read_direct(s, s->forward_map[address]);
-}
+    // refresh at most one block per call, after GC has had its turn
+    for (int i = 0; i < s->num_blocks; i++) {
+        int block = (s->reclaim_current_block + i) % s->num_blocks;
 
-char *write_ssd(SSD *s, int address, char data) {
-    s->logical_write_sum++;
-    if (address < 0 || address >= s->num_logical_pages) {
-        s->logical_write_fail_sum++;
-        return "fail: illegal write address";
-    }
-    if (s->ssd_type == TYPE_DIRECT) {
-        return write_direct(s, address, data);
-    } else if (s->ssd_type == TYPE_IDEAL) {
-        return write_ideal(s, address, data);
-    } else {
-        return write_logging(s, address, data, 0);
-    }
-}
+        // the open block is refreshed once it has been closed
+        if (!s->reclaim_pending[block] || is_open_block(s, block)) {
+            continue;
+        }
 
-char printable_state(int s) {
+        // refreshed data restarts its retention clock, so it goes to the host's
+        // open block rather than waiting in a slowly filling GC block
+        int live_pages[MAX_PAGES];
+        int live_count = collect_live_pages(s, block, live_pages);
+        if (migrate_live_pages(s, FRONTIER_HOST, "reclaim", s->read_reclaim_sum, live_pages, live_count) < live_count) {
+            return;
+        }
+        physical_erase(s, block);
+
+        if (s->gc_trace) {
+            printf("reclaim %d:: erase(block=%d)\n", s->read_reclaim_sum, block);
+        }
+        STAT(s->read_reclaim_sum++);
+        s->reclaim_current_block = (block + 1) % s->num_blocks;
+        return;
+    }
+}
+
+int slc_free_blocks(SSD *s) {
+    int free_blocks = 0;
+    for (int i = 0; i < s->slc_blocks; i++) {
+        free_blocks += !s->gc_used_blocks[i];
+    }
+    return free_blocks;
+}
+
+void fold_slc(SSD *s) {
+
+    // fold the oldest closed SLC block into the dense region
+    for (int i = 0; i < s->slc_blocks; i++) {
+        int block = (s->fold_current_block + i) % s->slc_blocks;
+        if (!s->gc_used_blocks[block] || is_filling_block(s, block)) {
+            continue;
+        }
+
+        // folded pages are fresh host data, so they join the host's dense block
+        int live_pages[MAX_PAGES];
+        int live_count = collect_live_pages(s, block, live_pages);
+        int moved = migrate_live_pages(s, FRONTIER_HOST, "fold", s->fold_block_sum, live_pages, live_count);
+        STAT(s->fold_page_sum += moved);
+
+        // dense region full: leave the rest cached and try again later
+        if (moved < live_count) {
+            return;
+        }
+
+        physical_erase(s, block);
+        if (s->gc_trace) {
+            printf("fold %d:: erase(block=%d)\n", s->fold_block_sum, block);
+        }
+        STAT(s->fold_block_sum++);
+        s->fold_current_block = (block + 1) % s->slc_blocks;
+        s->fold_credit = 0;
+        return;
+    }
+}
+
+void upkeep(SSD *s) {
+
+    // GARBAGE COLLECTION
+    if (blocks_in_use(s) >= s->gc_high_water_mark) {
+        PROF_BEGIN(s, PROF_GC);
+        garbage_collect(s);
+        PROF_END(s, PROF_GC);
+    }
+
+    // SLC FOLD-BACK: whenever the host is idle; with the cache full, only
+    // once a block's worth of host writes has gone straight to dense blocks
+    if (s->slc_blocks > 0) {
+        if (s->host_idle || (s->fold_credit >= s->pages_per_block && slc_free_blocks(s) == 0)) {
+            fold_slc(s);
+        }
+    }
+
+    // READ RECLAIM: lowest priority, relocates disturbed or aged blocks
+    if (s->read_disturb_threshold > 0 || s->retention_limit > 0) {
+        read_reclaim(s);
+    }
+    // WEAR LEVELING: for future
+}
+
+void upkeep_none(SSD *s) {
+    (void)s;
+}
+
+/*
+    Zoned Namespace
+
+    A zone is written strictly sequentially at its write pointer and only
+    reclaimed by an explicit reset, so the device does no GC of its own.
+    Plain r/w/t commands go through a minimal host-side log (the host map is
+    kept in forward_map/reverse_map) that appends into zones and reclaims
+    them itself, so ordinary traces can be compared against the log FTL.
+*/
+
+int zone_open_count(SSD *s) {
+    int open = 0;
+    for (int z = 0; z < s->num_zones; z++) {
+        open += (s->zone_state[z] == ZONE_IMPLICIT_OPEN || s->zone_state[z] == ZONE_EXPLICIT_OPEN);
+    }
+    return open;
+}
+
+int zone_acquire(SSD *s, int zone, int explicit_open) {
+    int state = s->zone_state[zone];
+    if (state == ZONE_EXPLICIT_OPEN || (state == ZONE_IMPLICIT_OPEN && !explicit_open)) {
+        return 0;
+    }
+    if (state == ZONE_FULL) {
+        return ZONE_ERR_FULL;
+    }
+
+    // opening a new zone needs an open resource; implicit opens may be reclaimed
+    if (state != ZONE_IMPLICIT_OPEN && s->max_open_zones > 0 &&
+        zone_open_count(s) >= s->max_open_zones) {
+        int victim = -1;
+        for (int z = 0; z < s->num_zones && victim == -1; z++) {
+            if (s->zone_state[z] == ZONE_IMPLICIT_OPEN) {
+                victim = z;
+            }
+        }
+        if (victim == -1) {
+            STAT(s->zone_open_fail_sum++);
+            return ZONE_ERR_TOO_MANY_OPEN;
+        }
+        s->zone_state[victim] = ZONE_CLOSED;
+    }
+    s->zone_state[zone] = explicit_open ? ZONE_EXPLICIT_OPEN : ZONE_IMPLICIT_OPEN;
+    return 0;
+}
+
+int zone_program(SSD *s, int zone, char data) {
+    int rc = zone_acquire(s, zone, 0);
+    if (rc < 0) {
+        return rc;
+    }
+
+    int page = s->zone_wp[zone];
+    int block = page / s->pages_per_block;
+    if (page % s->pages_per_block == 0 && s->state[page] == STATE_INVALID) {
+        physical_erase(s, block);
+    }
+    physical_program(s, page, data);
+    s->gc_used_blocks[block] = 1;
+
+    // the write pointer reaching the end releases the open resource
+    s->zone_wp[zone]++;
+    if (s->zone_wp[zone] == (zone + 1) * s->zone_pages) {
+        s->zone_state[zone] = ZONE_FULL;
+    }
+    return page;
+}
+
+int zone_write(SSD *s, int page_address, char data) {
+    if (page_address < 0 || page_address >= s->num_zones * s->zone_pages) {
+        return ZONE_ERR_BAD_ZONE;
+    }
+    int zone = page_address / s->zone_pages;
+
+    // a full zone has no write pointer left to match, so any write to it is invalid
+    if (s->zone_state[zone] == ZONE_FULL) {
+        STAT(s->zone_invalid_write_sum++);
+        return ZONE_ERR_FULL;
+    }
+    if (page_address != s->zone_wp[zone]) {
+        STAT(s->zone_invalid_write_sum++);
+        return ZONE_ERR_INVALID_WRITE;
+    }
+    return zone_program(s, zone, data);
+}
+
+int zone_append(SSD *s, int zone, char data) {
+    if (zone < 0 || zone >= s->num_zones) {
+        return ZONE_ERR_BAD_ZONE;
+    }
+    if (s->zone_state[zone] == ZONE_FULL) {
+        return ZONE_ERR_FULL;
+    }
+    return zone_program(s, zone, data);
+}
+
+int zone_reset(SSD *s, int zone) {
+    if (zone < 0 || zone >= s->num_zones) {
+        return ZONE_ERR_BAD_ZONE;
+    }
+
+    // whatever the host still mapped here is gone
+    int page_start = zone * s->zone_pages;
+    for (int page = page_start; page < s->zone_wp[zone]; page++) {
+        int logical_page = rmap_get(s, page);
+        if (logical_page != -1 && fmap_get(s, logical_page) == page) {
+            fmap_set(s, logical_page, -1);
+        }
+        rmap_set(s, page, -1);
+    }
+    if (s->zone_wp[zone] > page_start) {
+        for (int b = 0; b < s->zone_blocks; b++) {
+            physical_erase(s, zone * s->zone_blocks + b);
+        }
+    }
+    s->zone_wp[zone] = page_start;
+    s->zone_state[zone] = ZONE_EMPTY;
+    STAT(s->zone_reset_sum++);
+    return 0;
+}
+
+int zone_finish(SSD *s, int zone) {
+    if (zone < 0 || zone >= s->num_zones) {
+        return ZONE_ERR_BAD_ZONE;
+    }
+    s->zone_wp[zone] = (zone + 1) * s->zone_pages;
+    s->zone_state[zone] = ZONE_FULL;
+    STAT(s->zone_finish_sum++);
+    return 0;
+}
+
+int zone_open(SSD *s, int zone) {
+    if (zone < 0 || zone >= s->num_zones) {
+        return ZONE_ERR_BAD_ZONE;
+    }
+    return zone_acquire(s, zone, 1);
+}
+
+int zone_close(SSD *s, int zone) {
+    if (zone < 0 || zone >= s->num_zones) {
+        return ZONE_ERR_BAD_ZONE;
+    }
+    if (s->zone_state[zone] != ZONE_IMPLICIT_OPEN && s->zone_state[zone] != ZONE_EXPLICIT_OPEN) {
+        return ZONE_ERR_NOT_OPEN;
+    }
+    s->zone_state[zone] = (s->zone_wp[zone] == zone * s->zone_pages) ? ZONE_EMPTY : ZONE_CLOSED;
+    return 0;
+}
+
+char *zone_error(int rc) {
+    if (rc == ZONE_ERR_BAD_ZONE) {
+        return "fail: illegal zone";
+    } else if (rc == ZONE_ERR_FULL) {
+        return "fail: zone full";
+    } else if (rc == ZONE_ERR_INVALID_WRITE) {
+        return "fail: write not at write pointer";
+    } else if (rc == ZONE_ERR_TOO_MANY_OPEN) {
+        return "fail: too many open zones";
+    } else if (rc == ZONE_ERR_NOT_OPEN) {
+        return "fail: zone not open";
+    }
+    return "success";
+}
+
+char printable_zone_state(int state) {
+    if (state == ZONE_EMPTY) {
+        return 'e';
+    } else if (state == ZONE_IMPLICIT_OPEN) {
+        return 'o';
+    } else if (state == ZONE_EXPLICIT_OPEN) {
+        return 'O';
+    } else if (state == ZONE_CLOSED) {
+        return 'c';
+    } else {
+        return 'F';
+    }
+}
+
+char *zone_cmd(SSD *s, OP *op) {
+    if (s->ssd_type != TYPE_ZONED) {
+        return "fail: not a zoned device";
+    }
+
+    int rc;
+    if (op->op == 'W' || op->op == 'a') {
+        STAT(s->logical_write_sum++);
+        rc = (op->op == 'W') ? zone_write(s, op->address, op->data) : zone_append(s, op->address, op->data);
+        if (rc < 0) {
+            STAT(s->logical_write_fail_sum++);
+            return zone_error(rc);
+        }
+        if (op->op == 'a') {
+            snprintf(s->cmd_result, sizeof(s->cmd_result), "success: lba %d", rc);
+            return s->cmd_result;
+        }
+        return "success";
+    } else if (op->op == 'x') {
+        rc = zone_reset(s, op->address);
+    } else if (op->op == 'f') {
+        rc = zone_finish(s, op->address);
+    } else if (op->op == 'o') {
+        rc = zone_open(s, op->address);
+    } else if (op->op == 'c') {
+        rc = zone_close(s, op->address);
+    } else {
+        // zone report
+        if (op->address < 0 || op->address >= s->num_zones) {
+            return zone_error(ZONE_ERR_BAD_ZONE);
+        }
+        snprintf(s->cmd_result, sizeof(s->cmd_result), "state %c wp %d",
+                 printable_zone_state(s->zone_state[op->address]), s->zone_wp[op->address]);
+        return s->cmd_result;
+    }
+    return zone_error(rc);
+}
+
+int host_zone_append(SSD *s, int *zone, char data) {
+    if (*zone == -1 || s->zone_state[*zone] == ZONE_FULL) {
+        *zone = -1;
+        for (int z = 0; z < s->num_zones && *zone == -1; z++) {
+            if (s->zone_state[z] == ZONE_EMPTY) {
+                *zone = z;
+            }
+        }
+        if (*zone == -1) {
+            return ZONE_ERR_FULL;
+        }
+    }
+    return zone_append(s, *zone, data);
+}
+
+char *write_zoned(SSD *s, int page_address, char data) {
+    int page = host_zone_append(s, &s->host_zone, data);
+    if (page < 0) {
+        STAT(s->logical_write_fail_sum++);
+        return page == ZONE_ERR_FULL ? "failure: device full" : zone_error(page);
+    }
+    fmap_set(s, page_address, page);
+    rmap_set(s, page, page_address);
+    return "success";
+}
+
+int empty_zones(SSD *s) {
+    int empty = 0;
+    for (int z = 0; z < s->num_zones; z++) {
+        empty += (s->zone_state[z] == ZONE_EMPTY);
+    }
+    return empty;
+}
+
+void host_zone_reclaim(SSD *s) {
+
+    // besides the water marks, the host keeps a spare empty zone to reclaim into
+    while (blocks_in_use(s) > s->gc_low_water_mark || empty_zones(s) < 2) {
+
+        // the host picks the full zone with the least live data
+        int victim = -1;
+        int victim_live = s->zone_pages;
+        for (int z = 0; z < s->num_zones; z++) {
+            if (s->zone_state[z] != ZONE_FULL || z == s->host_zone || z == s->host_reclaim_zone) {
+                continue;
+            }
+            int live = 0;
+            for (int page = z * s->zone_pages; page < s->zone_wp[z]; page++) {
+                int logical_page = rmap_get(s, page);
+                live += (logical_page != -1 && fmap_get(s, logical_page) == page);
+            }
+            if (live < victim_live) {
+                victim = z;
+                victim_live = live;
+            }
+        }
+        if (victim == -1) {
+            return;
+        }
+
+        for (int page = victim * s->zone_pages; page < s->zone_wp[victim]; page++) {
+            int logical_page = rmap_get(s, page);
+            if (logical_page == -1 || fmap_get(s, logical_page) != page) {
+                continue;
+            }
+            if (s->gc_trace) {
+                printf("host-gc %d:: read(physical_page=%d)\n", s->host_reclaim_count, page);
+                printf("host-gc %d:: append()\n", s->host_reclaim_count);
+            }
+            char data = physical_read(s, page);
+            int new_page = host_zone_append(s, &s->host_reclaim_zone, data);
+            if (new_page < 0) {
+                new_page = host_zone_append(s, &s->host_zone, data);
+            }
+            if (new_page < 0) {
+                return;
+            }
+            STAT(s->host_reclaim_read_sum++);
+            STAT(s->host_reclaim_write_sum++);
+            fmap_set(s, logical_page, new_page);
+            rmap_set(s, new_page, logical_page);
+        }
+
+        zone_reset(s, victim);
+        if (s->gc_trace) {
+            printf("host-gc %d:: reset(zone=%d)\n", s->host_reclaim_count, victim);
+        }
+        s->host_reclaim_count++;
+    }
+}
+
+void upkeep_zoned(SSD *s) {
+
+    // HOST-MANAGED RECLAIM: the device itself never collects
+    if (blocks_in_use(s) >= s->gc_high_water_mark || empty_zones(s) < 2) {
+        PROF_BEGIN(s, PROF_GC);
+        host_zone_reclaim(s);
+        PROF_END(s, PROF_GC);
+    }
+}
+
+/*
+    Power-Loss Recovery
+
+    The forward map and every FTL cursor live in DRAM and are lost on power
+    loss; flash keeps each page's data and OOB record (logical page plus a
+    device-wide sequence number). Mount starts from the last map checkpoint,
+    if any, and scans only blocks programmed since it, one thread per channel.
+    The newest sequence number wins. A trim is durable only once checkpointed.
+*/
+
+int checkpoint_map_pages(int count) {
+    return count / CHECKPOINT_ENTRIES_PER_PAGE + 1;
+}
+
+void checkpoint_map(SSD *s) {
+    int count = 0;
+    for (int i = fmap_next(s, 0); i != -1; i = fmap_next(s, i + 1)) {
+        count++;
+    }
+    int *lba = realloc(s->checkpoint_lba, (count + 1) * sizeof(int));
+    int *page = realloc(s->checkpoint_page, (count + 1) * sizeof(int));
+    if (lba == NULL || page == NULL) {
+        printf("out of memory for map checkpoint\n");
+        exit(1);
+    }
+    s->checkpoint_lba = lba;
+    s->checkpoint_page = page;
+
+    int n = 0;
+    for (int i = fmap_next(s, 0); i != -1; i = fmap_next(s, i + 1)) {
+        s->checkpoint_lba[n] = i;
+        s->checkpoint_page[n] = fmap_get(s, i);
+        n++;
+    }
+    s->checkpoint_count = count;
+    s->checkpoint_seq = s->write_seq;
+
+    // written to a reserved system area, so it never competes for data blocks
+    STAT(s->checkpoint_sum++);
+    STAT(s->checkpoint_page_sum += checkpoint_map_pages(count));
+    STAT(s->checkpoint_time_sum += checkpoint_map_pages(count) * s->page_program_time);
+}
+
+void *scan_channel(void *arg) {
+    SCAN *sc = (SCAN *)arg;
+    SSD *s = sc->s;
+    for (int block = sc->first_block; block < sc->last_block; block++) {
+        float read_time = (block < s->slc_blocks) ? s->slc_read_time : s->page_read_time;
+
+        // probing the last programmed page shows whether the block predates the checkpoint
+        if (s->block_seq[block] <= s->checkpoint_seq) {
+            sc->pages_read++;
+            sc->scan_time += read_time;
+            continue;
+        }
+        sc->blocks_scanned++;
+        int page_start = block * s->pages_per_block;
+        for (int page = page_start; page < page_start + s->pages_per_block; page++) {
+            if (s->state[page] != STATE_VALID) {
+                continue;
+            }
+            sc->pages_read++;
+            sc->scan_time += read_time;
+            if (s->oob_seq[page] > s->checkpoint_seq && rmap_get(s, page) != -1) {
+                sc->pages[sc->page_count++] = page;
+            }
+        }
+    }
+    return NULL;
+}
+
+void mount_ssd(SSD *s) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // the map restarts from the last checkpoint (or empty)
+    for (int i = fmap_next(s, 0); i != -1; i = fmap_next(s, i + 1)) {
+        fmap_set(s, i, -1);
+    }
+    float load_time = 0;
+    if (s->checkpoint_lba != NULL) {
+        for (int i = 0; i < s->checkpoint_count; i++) {
+            fmap_set(s, s->checkpoint_lba[i], s->checkpoint_page[i]);
+        }
+        load_time = checkpoint_map_pages(s->checkpoint_count) * s->page_read_time;
+    }
+
+    SCAN scans[MAX_SHARDS];
+    int channels = s->mount_channels;
+    for (int c = 0; c < channels; c++) {
+        SCAN *sc = &scans[c];
+        sc->s = s;
+        sc->first_block = c * s->num_blocks / channels;
+        sc->last_block = (c + 1) * s->num_blocks / channels;
+        sc->pages = malloc(((sc->last_block - sc->first_block) * s->pages_per_block + 1) * sizeof(int));
+        if (sc->pages == NULL) {
+            printf("out of memory for mount scan\n");
+            exit(1);
+        }
+        sc->page_count = 0;
+        sc->blocks_scanned = 0;
+        sc->pages_read = 0;
+        sc->scan_time = 0;
+        if (pthread_create(&sc->thread, NULL, scan_channel, sc) != 0) {
+            printf("failed to start mount scan %d\n", c);
+            exit(1);
+        }
+    }
+
+    // channels scan concurrently; the slowest one bounds the mount
+    float scan_time = 0;
+    s->mount_blocks_scanned = 0;
+    s->mount_pages_read = 0;
+    for (int c = 0; c < channels; c++) {
+        SCAN *sc = &scans[c];
+        pthread_join(sc->thread, NULL);
+        for (int i = 0; i < sc->page_count; i++) {
+            int page = sc->pages[i];
+            int logical_page = rmap_get(s, page);
+            int old_page = fmap_get(s, logical_page);
+            if (old_page == -1 || s->state[old_page] != STATE_VALID ||
+                rmap_get(s, old_page) != logical_page || s->oob_seq[old_page] < s->oob_seq[page]) {
+                fmap_set(s, logical_page, page);
+            }
+        }
+        s->mount_blocks_scanned += sc->blocks_scanned;
+        s->mount_pages_read += sc->pages_read;
+        if (sc->scan_time > scan_time) {
+            scan_time = sc->scan_time;
+        }
+        free(sc->pages);
+    }
+
+    // checkpoint entries whose page was since erased or rewritten are stale
+    s->mount_recovered = 0;
+    s->mount_stale = 0;
+    for (int i = fmap_next(s, 0); i != -1; i = fmap_next(s, i + 1)) {
+        int page = fmap_get(s, i);
+        if (page < 0 || s->state[page] != STATE_VALID || rmap_get(s, page) != i) {
+            fmap_set(s, i, -1);
+            s->mount_stale++;
+        } else {
+            s->mount_recovered++;
+        }
+    }
+
+    // partially written blocks stay closed and are left to GC; new writes start in fresh blocks
+    for (int f = 0; f < MAX_FRONTIERS; f++) {
+        s->current_page[f] = -1;
+        s->current_block[f] = -1;
+    }
+    for (int block = 0; block < s->num_blocks; block++) {
+        s->gc_used_blocks[block] = (s->block_seq[block] > 0);
+    }
+    s->fold_credit = 0;
+
+    // open zones lose their open resource and come back closed
+    if (s->ssd_type == TYPE_ZONED) {
+        for (int z = 0; z < s->num_zones; z++) {
+            if (s->zone_state[z] == ZONE_IMPLICIT_OPEN || s->zone_state[z] == ZONE_EXPLICIT_OPEN) {
+                s->zone_state[z] = (s->zone_wp[z] == z * s->zone_pages) ? ZONE_EMPTY : ZONE_CLOSED;
+            }
+        }
+    }
+
+    s->mount_time = load_time + scan_time;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    s->mount_wall_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+}
+
+char *power_loss(SSD *s) {
+    STAT(s->power_loss_sum++);
+
+    // remember where every mapped page lived, to check the mount against
+    int *lba = malloc((s->num_pages + 1) * sizeof(int));
+    int *page = malloc((s->num_pages + 1) * sizeof(int));
+    if (lba == NULL || page == NULL) {
+        printf("out of memory for power loss\n");
+        exit(1);
+    }
+    int count = 0;
+    for (int i = fmap_next(s, 0); i != -1; i = fmap_next(s, i + 1)) {
+        lba[count] = i;
+        page[count] = fmap_get(s, i);
+        count++;
+    }
+
+    mount_ssd(s);
+
+    // every page readable before the crash must map to the same copy; trimmed
+    // pages come back only if the trim was not yet checkpointed
+    int unmapped = 0;
+    s->mount_lost = 0;
+    for (int i = 0; i < count; i++) {
+        int new_page = fmap_get(s, lba[i]);
+        if (new_page != page[i]) {
+            s->mount_lost++;
+            unmapped += (new_page == -1);
+        }
+    }
+    s->mount_resurrected = s->mount_recovered - (count - unmapped);
+    free(lba);
+    free(page);
+    snprintf(s->cmd_result, sizeof(s->cmd_result), "mounted %d pages in %.2f",
+             s->mount_recovered, s->mount_time);
+    return s->cmd_result;
+}
+
+char *trim(SSD *s, int address) {
+    STAT(s->logical_trim_sum++);
+    if (address < 0 || address >= s->num_logical_pages) {
+        STAT(s->logical_trim_fail_sum++);
+        return "fail: illegal trim address";
+    }
+    if (fmap_get(s, address) == -1) {
+        STAT(s->logical_trim_fail_sum++);
+        return "fail: uninitialized trim";
+    }
+    fmap_set(s, address, -1);
+    return "success";
+}
+
+char *read_ssd(SSD *s, int address) {
+    STAT(s->logical_read_sum++);
+    if (address < 0 || address >= s->num_logical_pages) {
+        STAT(s->logical_read_fail_sum++);
+        return "fail: illegal read address";
+    }
+    if (fmap_get(s, address) == -1) {
+        STAT(s->logical_read_fail_sum++);
+        return "fail: uninitialized read";
+    }
+
+    // USED for DIRECT and LOGGING and IDEAL
+    return read_direct(s, fmap_get(s, address));
+}
+
+char printable_state(int s) {
     if (s == STATE_INVALID) {
         return 'i';
     } else if (s == STATE_ERASED) {
@@ -453,129 +2000,956 @@ char printable_state(int s) {
     }
 }
 
-void stats(SSD *s) {
-    printf("Physical Operations Per Block\n");
-    printf("Erases ");
-    for (int i = 0; i < s->num_blocks; i++) {
-        printf("%3d        ", s->physical_erase_count[i]);
+void stats(SSD *s) {
+    if (!SSD_STATS) {
+        printf("Statistics compiled out (built with SSD_STATS=0)\n");
+        return;
+    }
+    printf("Physical Operations Per Block\n");
+    printf("Erases ");
+    for (int i = 0; i < s->num_blocks; i++) {
+        printf("%3d        ", s->physical_erase_count[i]);
+    }
+    printf("  Sum: %d\n", s->physical_erase_sum);
+
+    printf("Writes ");
+    for (int i = 0; i < s->num_blocks; i++) {
+        printf("%3d        ", s->physical_write_count[i]);
+    }
+    printf("  Sum: %d\n", s->physical_write_sum);
+
+    printf("Reads  ");
+    for (int i = 0; i < s->num_blocks; i++) {
+        printf("%3d        ", s->physical_read_count[i]);
+    }
+    printf("  Sum: %d\n", s->physical_read_sum);
+    printf("\n");
+    if (s->slc_blocks > 0) {
+        printf("pSLC Cache (%d blocks)\n", s->slc_blocks);
+        printf("  Host writes to SLC %d, to dense %d\n", s->slc_write_sum, s->dense_write_sum);
+        printf("  Folded %d pages from %d blocks\n", s->fold_page_sum, s->fold_block_sum);
+        float now = busy_time(s);
+        int shown = s->num_phases < MAX_PHASES ? s->num_phases : MAX_PHASES;
+        for (int i = 0; i < shown; i++) {
+            float end_time = (i + 1 < shown) ? s->phases[i + 1].start_time :
+                             (s->num_phases > MAX_PHASES ? s->phases[i].start_time : now);
+            float phase_time = end_time - s->phases[i].start_time;
+            printf("  Phase %2d  %-5s  host writes %4d  time %10.2f  writes/1000t %8.2f\n",
+                   i, s->phases[i].slc ? "slc" : "dense", s->phases[i].host_writes, phase_time,
+                   phase_time > 0 ? s->phases[i].host_writes * 1000.0 / phase_time : 0.0);
+        }
+        if (s->num_phases > MAX_PHASES) {
+            printf("  ... %d more phases\n", s->num_phases - MAX_PHASES);
+        }
+
+        // totals per region, including the phase still running
+        float region_time[2] = { s->region_time[0], s->region_time[1] };
+        if (s->num_phases > 0) {
+            region_time[s->phase_slc] += now - s->phase_start;
+        }
+        int region_writes[2] = { s->dense_write_sum, s->slc_write_sum };
+        for (int r = 1; r >= 0; r--) {
+            printf("  Total     %-5s  host writes %4d  time %10.2f  writes/1000t %8.2f\n",
+                   r ? "slc" : "dense", region_writes[r], region_time[r],
+                   region_time[r] > 0 ? region_writes[r] * 1000.0 / region_time[r] : 0.0);
+        }
+        printf("\n");
+    }
+    if (s->read_disturb_threshold > 0 || s->retention_limit > 0) {
+        printf("Read Disturb / Retention\n");
+        printf("  Read retries %d\n", s->read_retry_sum);
+        printf("  Blocks reclaimed %d\n", s->read_reclaim_sum);
+        printf("\n");
+    }
+    printf("Logical Operation Sums\n");
+    printf("  Write count %d (%d failed)\n", s->logical_write_sum, s->logical_write_fail_sum);
+    printf("  Read count  %d (%d failed)\n", s->logical_read_sum, s->logical_read_fail_sum);
+    printf("  Trim count  %d (%d failed)\n", s->logical_trim_sum, s->logical_trim_fail_sum);
+    printf("\n");
+    if (s->ssd_type == TYPE_ZONED) {
+        printf("Zoned Device (%d zones of %d blocks, max open %d)\n", s->num_zones, s->zone_blocks,
+               s->max_open_zones);
+        printf("  Zone resets %d, finishes %d\n", s->zone_reset_sum, s->zone_finish_sum);
+        printf("  Invalid writes %d, open limit failures %d\n", s->zone_invalid_write_sum,
+               s->zone_open_fail_sum);
+        printf("  Host reclaim reads %d, writes %d\n", s->host_reclaim_read_sum,
+               s->host_reclaim_write_sum);
+        int device_writes = s->logical_write_sum - s->logical_write_fail_sum + s->host_reclaim_write_sum;
+        printf("  Device write amplification %.2f\n",
+               device_writes > 0 ? (float)s->physical_write_sum / device_writes : 0.0);
+        printf("\n");
+    }
+    if (s->sparse_map) {
+        long leaves = s->forward_leaf_count + s->reverse_leaf_count;
+        long directory = map_directory_size(s->num_logical_pages) + map_directory_size(s->num_pages);
+        printf("Sparse Map\n");
+        printf("  Forward leaves %d, reverse leaves %d (%d entries each)\n",
+               s->forward_leaf_count, s->reverse_leaf_count, MAP_LEAF_SIZE);
+        // the directory is dense and still grows with the logical capacity
+        long leaf_bytes = leaves * MAP_LEAF_SIZE * (long)sizeof(int);
+        long directory_bytes = directory * (long)sizeof(int *);
+        printf("  Map memory %ld bytes: leaves %ld, directory %ld (dense would be %ld)\n",
+               leaf_bytes + directory_bytes, leaf_bytes, directory_bytes,
+               ((long)s->num_logical_pages + s->num_pages) * (long)sizeof(int));
+        printf("\n");
+    }
+    int streams_used = (s->hot_threshold > 0);
+    for (int i = 1; i < MAX_STREAMS; i++) {
+        streams_used |= (s->stream_host_writes[i] > 0);
+    }
+    if (streams_used) {
+        printf("Write Streams");
+        if (s->hot_threshold > 0) {
+            printf(" (hot at %d writes per %d-page region)", s->hot_threshold, 1 << s->heat_region_bits);
+        }
+        printf("\n");
+        for (int i = 0; i < MAX_STREAMS; i++) {
+            if (s->stream_host_writes[i] == 0 && s->stream_gc_writes[i] == 0) {
+                continue;
+            }
+            printf("  Stream %d  host writes %5d  gc writes %5d  write amplification %.2f\n", i,
+                   s->stream_host_writes[i], s->stream_gc_writes[i],
+                   s->stream_host_writes[i] > 0 ?
+                   (float)(s->stream_host_writes[i] + s->stream_gc_writes[i]) / s->stream_host_writes[i] : 0.0);
+        }
+        printf("\n");
+    }
+    printf("Relocation Sums\n");
+    printf("  GC read count  %d\n", s->gc_read_sum);
+    printf("  GC write count %d (%d by copyback)\n", s->gc_write_sum, s->copyback_sum);
+    int host_writes = s->logical_write_sum - s->logical_write_fail_sum;
+    printf("  Write amplification %.2f\n",
+           host_writes > 0 ? (float)s->physical_write_sum / host_writes : 0.0);
+    printf("\n");
+    if (s->checkpoint_sum > 0 || s->power_loss_sum > 0) {
+        printf("Power-Loss Recovery (%d mount channels)\n", s->mount_channels);
+        printf("  Checkpoints %d (%d map pages written)\n", s->checkpoint_sum, s->checkpoint_page_sum);
+        printf("  Power losses %d\n", s->power_loss_sum);
+        if (s->power_loss_sum > 0) {
+            printf("  Last mount: %d blocks scanned, %d pages read\n", s->mount_blocks_scanned,
+                   s->mount_pages_read);
+            printf("  Last mount: %d pages recovered, %d stale checkpoint entries dropped\n",
+                   s->mount_recovered, s->mount_stale);
+            printf("  Last mount: %d pages lost or remapped, %d trimmed pages resurrected\n",
+                   s->mount_lost, s->mount_resurrected);
+            printf("  Last mount time %.2f (wall %.3f ms)\n", s->mount_time, s->mount_wall_ms);
+        }
+        printf("\n");
+    }
+    printf("Times\n");
+    printf("  Erase time %.2f\n", s->erase_time_sum);
+    printf("  Write time %.2f\n", s->write_time_sum);
+    printf("  Read time  %.2f\n", s->read_time_sum);
+    if (s->read_retry_sum > 0) {
+        printf("  Retry time %.2f\n", s->read_retry_sum * s->read_retry_time);
+    }
+    if (s->copyback_sum > 0) {
+        printf("  Copyback time %.2f\n", s->copyback_time_sum);
+    }
+    if (s->checkpoint_sum > 0) {
+        printf("  Checkpoint time %.2f\n", s->checkpoint_time_sum);
+    }
+    printf("  Total time %.2f\n", busy_time(s));
+}
+
+void profile_report(SSD *s, long wall_ns) {
+    long ops = s->prof_calls[PROF_DISPATCH];
+    printf("Profile (wall %.3f ms, %ld ops, %.0f simulated ops/s; nested phases are inclusive)\n",
+           wall_ns / 1e6, ops, wall_ns > 0 ? ops * 1e9 / wall_ns : 0.0);
+
+    // GC scanning is whatever GC time was not spent migrating live pages
+    const char *names[] = { "dispatch", "get_cursor", "upkeep", "gc scan", "gc migrate", "output" };
+    long ns[] = { s->prof_ns[PROF_DISPATCH], s->prof_ns[PROF_CURSOR], s->prof_ns[PROF_UPKEEP],
+                  s->prof_ns[PROF_GC] - s->prof_ns[PROF_GC_MIGRATE], s->prof_ns[PROF_GC_MIGRATE],
+                  s->prof_ns[PROF_OUTPUT] };
+    long calls[] = { s->prof_calls[PROF_DISPATCH], s->prof_calls[PROF_CURSOR], s->prof_calls[PROF_UPKEEP],
+                     s->prof_calls[PROF_GC], s->prof_calls[PROF_GC_MIGRATE], s->prof_calls[PROF_OUTPUT] };
+    for (int i = 0; i < (int)(sizeof(ns) / sizeof(ns[0])); i++) {
+        printf("  %-10s  calls %8ld  time %10.3f ms  %5.1f%%  per call %8.0f ns\n", names[i], calls[i],
+               ns[i] / 1e6, wall_ns > 0 ? 100.0 * ns[i] / wall_ns : 0.0,
+               calls[i] > 0 ? (double)ns[i] / calls[i] : 0.0);
+    }
+}
+
+void dump(SSD *s) {
+
+    // FTL
+    printf("FTL   ");
+    int count = 0;
+    int ftl_columns = (s->pages_per_block * s->num_blocks) / 7;
+    for (int i = fmap_next(s, 0); i != -1; i = fmap_next(s, i + 1)) {
+        count++;
+        printf("%3d:%3d ", i, fmap_get(s, i));
+        if (count > 0 && count % ftl_columns == 0) {
+            printf("\n      ");
+        }
+    }
+    if (count == 0) {
+        printf("(empty)");
+    }
+    printf("\n");
+
+    // Blocks
+    printf("Block ");
+    for (int i = 0; i < s->num_blocks; i++) {
+        printf("%d", i);
+        for (int j = 0; j < s->pages_per_block - 1; j++) {
+            printf(" ");
+        }
+        printf(" ");
+    }
+    printf("\n");
+
+    // Zones
+    if (s->ssd_type == TYPE_ZONED) {
+        printf("Zone  ");
+        for (int i = 0; i < s->num_blocks; i++) {
+            int zone = i / s->zone_blocks;
+            if (zone < s->num_zones && i % s->zone_blocks == 0) {
+                printf("%c", printable_zone_state(s->zone_state[zone]));
+            } else {
+                printf(" ");
+            }
+            for (int j = 0; j < s->pages_per_block - 1; j++) {
+                printf(" ");
+            }
+            printf(" ");
+        }
+        printf("\n");
+    }
+
+    // Pages
+    int max_len = snprintf(NULL, 0, "%d", s->num_pages - 1);
+    for (int n = max_len; n > 0; n--) {
+        if (n == max_len) {
+            printf("Page  ");
+        } else {
+            printf("      ");
+        }
+        for (int i = 0; i < s->num_pages; i++) {
+            char buf[10];
+            snprintf(buf, sizeof(buf), "%0*d", max_len, i);
+            printf("%c", buf[max_len - n]);
+            if (i > 0 && (i + 1) % 10 == 0) {
+                printf(" ");
+            }
+        }
+        printf("\n");
+    }
+
+    // State
+    printf("State ");
+    for (int i = 0; i < s->num_pages; i++) {
+        printf("%c", printable_state(s->state[i]));
+        if (i > 0 && (i + 1) % 10 == 0) {
+            printf(" ");
+        }
+    }
+    printf("\n");
+
+    // Data
+    printf("Data  ");
+    for (int i = 0; i < s->num_pages; i++) {
+        if (s->state[i] == STATE_VALID) {
+            printf("%c", s->data[i]);
+        } else {
+            printf(" ");
+        }
+        if (i > 0 && (i + 1) % 10 == 0) {
+            printf(" ");
+        }
+    }
+    printf("\n");
+
+    // Live
+    printf("Live  ");
+    for (int i = 0; i < s->num_pages; i++) {
+        int logical_page = rmap_get(s, i);
+        if (s->state[i] == STATE_VALID && logical_page != -1 && fmap_get(s, logical_page) == i) {
+            printf("+");
+        } else {
+            printf(" ");
+        }
+        if (i > 0 && (i + 1) % 10 == 0) {
+            printf(" ");
+        }
+    }
+    printf("\n");
+}
+
+
+/*
+    Command Handling
+*/
+
+int parse_cmd(char *cmd, OP *op) {
+    op->index = -1;
+    op->op = cmd[0];
+    op->address = atoi(cmd + 1);
+    op->data = ' ';
+    op->stream = -1;
+    if (cmd[0] == 'w' || cmd[0] == 'W' || cmd[0] == 'a') {
+        char *colon = strchr(cmd, ':');
+        if (colon != NULL) {
+            op->data = colon[1];
+
+            // w<lba>:<c>:<stream> carries a write stream hint
+            if (cmd[0] == 'w' && colon[1] != '\0' && colon[2] == ':') {
+                op->stream = atoi(colon + 3);
+            }
+        }
+    }
+    if (cmd[0] == '\0' || strchr("rwtWaxfoczp", cmd[0]) == NULL) {
+        // unknown commands are kept (they still drive upkeep) but never applied
+        op->op = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void report_cmd(FILE *out, int op_num, OP *op, char *rc, REPORT *r) {
+    if (r->show_cmds || (r->quiz_cmds && r->solve)) {
+        if (op->op == 'r') {
+            fprintf(out, "cmd %3d:: read(%d) -> %s\n", op_num, op->address, rc);
+        } else if (op->op == 'w' && op->stream >= 0) {
+            fprintf(out, "cmd %3d:: write(%d, %c, stream %d) -> %s\n", op_num, op->address, op->data,
+                    op->stream, rc);
+        } else if (op->op == 'w') {
+            fprintf(out, "cmd %3d:: write(%d, %c) -> %s\n", op_num, op->address, op->data, rc);
+        } else if (op->op == 't') {
+            fprintf(out, "cmd %3d:: trim(%d) -> %s\n", op_num, op->address, rc);
+        } else if (op->op == 'W') {
+            fprintf(out, "cmd %3d:: zone_write(%d, %c) -> %s\n", op_num, op->address, op->data, rc);
+        } else if (op->op == 'a') {
+            fprintf(out, "cmd %3d:: zone_append(%d, %c) -> %s\n", op_num, op->address, op->data, rc);
+        } else if (op->op == 'p') {
+            fprintf(out, "cmd %3d:: power_loss() -> %s\n", op_num, rc);
+        } else {
+            const char *name = (op->op == 'x') ? "zone_reset" : (op->op == 'f') ? "zone_finish" :
+                               (op->op == 'o') ? "zone_open" : (op->op == 'c') ? "zone_close" :
+                               "zone_report";
+            fprintf(out, "cmd %3d:: %s(%d) -> %s\n", op_num, name, op->address, rc);
+        }
+    } else if (r->quiz_cmds) {
+        if (op->op == 'r') {
+            fprintf(out, "cmd %3d:: read(%d) -> ??\n", op_num, op->address);
+        } else {
+            fprintf(out, "cmd %3d:: command(??) -> ??\n", op_num);
+        }
+    }
+}
+
+
+/*
+    Trace Source
+*/
+
+void initialize_trace(TRACE *t, int seed, char *cmd_list, const char *op_percentages,
+                      const char *skew, int skew_start, int read_fail, int num_cmds,
+                      int num_logical_pages) {
+    memset(t, 0, sizeof(TRACE));
+
+    if (strlen(cmd_list) > 0) {
+
+        // count the commands up front so a crash point can be checked
+        t->list = cmd_list;
+        t->list_next = cmd_list;
+        for (char *c = cmd_list + strspn(cmd_list, ","); *c != '\0'; c += strspn(c, ",")) {
+            t->has_power_loss |= (*c == 'p');
+            t->cmd_total++;
+            c += strcspn(c, ",");
+        }
+        return;
+    }
+
+    int percent_trims = 0;
+    sscanf(op_percentages, "%d/%d/%d", &t->percent_reads, &t->percent_writes, &percent_trims);
+    if (t->percent_writes <= 0) {
+        printf("must have some writes, otherwise nothing in the SSD!\n");
+        exit(1);
+    }
+    t->total_percent = t->percent_reads + t->percent_writes + percent_trims;
+    t->cmd_total = num_cmds;
+    t->cmds_left = num_cmds;
+    t->max_page_addr = num_logical_pages;
+    t->read_fail = read_fail;
+    seed_trace(t, seed);
+
+    // skew "a/b": a% of writes go to the first b% of the logical space
+    t->skew_start = skew_start;
+    if (strlen(skew) > 0) {
+        sscanf(skew, "%d/%d", &t->skew_writes, &t->skew_space);
+        t->has_skew = 1;
+    }
+
+    t->slot_cap = 1024;
+    t->slots = malloc(t->slot_cap * sizeof(int));
+    t->live_tree = calloc(t->slot_cap + 1, sizeof(int));
+    t->written_leaves = calloc(map_directory_size(num_logical_pages), sizeof(int *));
+    if (t->slots == NULL || t->live_tree == NULL || t->written_leaves == NULL) {
+        printf("out of memory for the trace generator\n");
+        exit(1);
+    }
+}
+
+void free_trace(TRACE *t) {
+    if (t->written_leaves != NULL) {
+        for (long i = 0; i < map_directory_size(t->max_page_addr); i++) {
+            free(t->written_leaves[i]);
+        }
+    }
+    free(t->written_leaves);
+    free(t->slots);
+    free(t->live_tree);
+}
+
+// same seeding as glibc's srand(): a Park-Miller sequence, then 310 draws discarded
+void seed_trace(TRACE *t, int seed) {
+    int word = (seed == 0) ? 1 : seed;
+    t->rng[0] = word;
+    for (int i = 1; i < 31; i++) {
+        int hi = word / 127773;
+        int lo = word % 127773;
+        word = 16807 * lo - 2836 * hi;
+        if (word < 0) {
+            word += 2147483647;
+        }
+        t->rng[i] = word;
+    }
+    for (int i = 31; i < 34; i++) {
+        t->rng[i] = t->rng[i - 31];
+    }
+    t->rng_next = 0;
+    for (int i = 0; i < 310; i++) {
+        trace_rand(t);
+    }
+}
+
+// r[i] = r[i-31] + r[i-3], kept in a ring of 34 words
+int trace_rand(TRACE *t) {
+    int i = t->rng_next;
+    t->rng[i] = t->rng[(i + 3) % 34] + t->rng[(i + 31) % 34];
+    t->rng_next = (i + 1) % 34;
+    return t->rng[i] >> 1;
+}
+
+void rebuild_live_tree(TRACE *t) {
+    memset(t->live_tree, 0, (t->slot_cap + 1) * sizeof(int));
+    for (int i = 1; i <= t->slot_cap; i++) {
+        t->live_tree[i] += (i <= t->slot_count && t->slots[i - 1] != -1);
+        int parent = i + (i & -i);
+        if (parent <= t->slot_cap) {
+            t->live_tree[parent] += t->live_tree[i];
+        }
+    }
+}
+
+void add_written_address(TRACE *t, int address) {
+    int *written = &map_leaf(t->written_leaves, &t->written_leaf_count, address)[address & (MAP_LEAF_SIZE - 1)];
+    if (*written == 1) {
+        return;
+    }
+    *written = 1;
+
+    if (t->slot_count == t->slot_cap) {
+
+        // squeeze out trimmed slots (order is kept) if that frees half, else grow
+        if (t->live_count * 2 <= t->slot_count) {
+            int kept = 0;
+            for (int i = 0; i < t->slot_count; i++) {
+                if (t->slots[i] != -1) {
+                    t->slots[kept++] = t->slots[i];
+                }
+            }
+            t->slot_count = kept;
+        } else {
+            t->slot_cap *= 2;
+            t->slots = realloc(t->slots, t->slot_cap * sizeof(int));
+            t->live_tree = realloc(t->live_tree, (t->slot_cap + 1) * sizeof(int));
+            if (t->slots == NULL || t->live_tree == NULL) {
+                printf("out of memory for the trace generator\n");
+                exit(1);
+            }
+        }
+        rebuild_live_tree(t);
+    }
+
+    t->slots[t->slot_count++] = address;
+    t->live_count++;
+    for (int i = t->slot_count; i <= t->slot_cap; i += i & -i) {
+        t->live_tree[i]++;
+    }
+}
+
+// slot of the k-th live address (from 0), by descending the Fenwick tree
+int find_live_slot(TRACE *t, int k) {
+    int pos = 0;
+
+    // slot_cap is a power of two, so it is the tree's top step and pos + step
+    // never passes it. The descent is branch-free: its turns are random
+    for (int step = t->slot_cap; step > 0; step /= 2) {
+        int count = t->live_tree[pos + step];
+        int take = (count <= k);
+        pos += take * step;
+        k -= take * count;
     }
-    printf("  Sum: %d\n", s->physical_erase_sum);
+    return pos;
+}
 
-    printf("Writes ");
-    for (int i = 0; i < s->num_blocks; i++) {
-        printf("%3d        ", s->physical_write_count[i]);
+void remove_live_slot(TRACE *t, int slot) {
+    int address = t->slots[slot];
+    t->written_leaves[address >> MAP_LEAF_BITS][address & (MAP_LEAF_SIZE - 1)] = -1;
+    t->slots[slot] = -1;
+    t->live_count--;
+    for (int i = slot + 1; i <= t->slot_cap; i += i & -i) {
+        t->live_tree[i]--;
     }
-    printf("  Sum: %d\n", s->physical_write_sum);
+}
 
-    printf("Reads  ");
-    for (int i = 0; i < s->num_blocks; i++) {
-        printf("%3d        ", s->physical_read_count[i]);
+void generate_op(TRACE *t, OP *op) {
+    static const char printable[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+    // reads and trims need something written first; those draws are retried
+    while (1) {
+        int which_cmd = trace_rand(t) % t->total_percent;
+        if (which_cmd < t->percent_reads) {
+
+            // read
+            int address;
+            if (trace_rand(t) % 100 < t->read_fail) {
+                address = trace_rand(t) % t->max_page_addr;
+            } else {
+                if (t->live_count < 2) {
+                    continue;
+                }
+                address = t->slots[find_live_slot(t, trace_rand(t) % t->live_count)];
+            }
+            *op = (OP){ .index = -1, .op = 'r', .address = address, .data = ' ', .stream = -1 };
+            return;
+        } else if (which_cmd < t->percent_reads + t->percent_writes) {
+
+            // write
+            int address;
+            if (t->skew_start == 0 && t->has_skew && ((float)trace_rand(t) / RAND_MAX) < (t->skew_writes / 100.0)) {
+                address = trace_rand(t) % (int)(t->skew_space / 100.0 * (t->max_page_addr - 1));
+            } else {
+                address = trace_rand(t) % t->max_page_addr;
+            }
+            add_written_address(t, address);
+            char data = printable[trace_rand(t) % (sizeof(printable) - 1)];
+            *op = (OP){ .index = -1, .op = 'w', .address = address, .data = data, .stream = -1 };
+            if (t->skew_start > 0) {
+                t->skew_start--;
+            }
+            return;
+        } else {
+
+            // trim
+            if (t->live_count < 1) {
+                continue;
+            }
+            int slot = find_live_slot(t, trace_rand(t) % t->live_count);
+            *op = (OP){ .index = -1, .op = 't', .address = t->slots[slot], .data = ' ', .stream = -1 };
+            remove_live_slot(t, slot);
+            return;
+        }
     }
-    printf("  Sum: %d\n", s->physical_read_sum);
-    printf("\n");
-    printf("Logical Operation Sums\n");
-    printf("  Write count %d (%d failed)\n", s->logical_write_sum, s->logical_write_fail_sum);
-    printf("  Read count  %d (%d failed)\n", s->logical_read_sum, s->logical_read_fail_sum);
-    printf("  Trim count  %d (%d failed)\n", s->logical_trim_sum, s->logical_trim_fail_sum);
-    printf("\n");
-    printf("Times\n");
-    printf("  Erase time %.2f\n", s->physical_erase_sum * s->block_erase_time);
-    printf("  Write time %.2f\n", s->physical_write_sum * s->page_program_time);
-    printf("  Read time  %.2f\n", s->physical_read_sum * s->page_read_time);
-    float total_time = s->physical_erase_sum * s->block_erase_time +
-                       s->physical_write_sum * s->page_program_time +
-                       s->physical_read_sum * s->page_read_time;
-    printf("  Total time %.2f\n", total_time);
 }
 
-void dump(SSD *s) {
+int next_op(TRACE *t, OP *op) {
 
-    // FTL
-    printf("FTL   ");
-    int count = 0;
-    int ftl_columns = (s->pages_per_block * s->num_blocks) / 7;
-    for (int i = 0; i < s->num_logical_pages; i++) {
-        if (s->forward_map[i] == -1) {
-            continue;
+    // the injected power loss follows the given command
+    if (t->crash_after > 0 && t->emitted == t->crash_after) {
+        char cmd[] = "p";
+        parse_cmd(cmd, op);
+        t->emitted++;
+        return 1;
+    }
+
+    if (t->list != NULL) {
+        char *token = t->list_next + strspn(t->list_next, ",");
+        if (*token == '\0') {
+            return 0;
         }
-        count++;
-        printf("%3d:%3d ", i, s->forward_map[i]);
-        if (count > 0 && count % ftl_columns == 0) {
-            printf("\n      ");
+        size_t len = strcspn(token, ",");
+        t->list_next = token + len + (token[len] != '\0');
+        token[len] = '\0';
+        parse_cmd(token, op);
+    } else {
+        if (t->cmds_left == 0) {
+            return 0;
         }
+        generate_op(t, op);
+        t->cmds_left--;
     }
-    if (count == 0) {
-        printf("(empty)");
+    t->emitted++;
+    return 1;
+}
+
+
+/*
+    Specialised Replay Engines
+*/
+
+#define DEFINE_FTL(name, WRITE, UPKEEP)                                         \
+                                                                                \
+static inline char *apply_cmd_##name(SSD *s, OP *op) {                          \
+    s->op_clock++;                                                              \
+    s->host_idle = (op->op != 'w');                                             \
+    if (op->op == 'r') {                                                        \
+        return read_ssd(s, op->address);                                        \
+    } else if (op->op == 't') {                                                 \
+        return trim(s, op->address);                                            \
+    } else if (op->op == 'p') {                                                 \
+        return power_loss(s);                                                   \
+    } else if (op->op != 'w') {                                                 \
+        return zone_cmd(s, op);                                                 \
+    }                                                                           \
+    STAT(s->logical_write_sum++);                                               \
+    if (op->address < 0 || op->address >= s->num_logical_pages) {               \
+        STAT(s->logical_write_fail_sum++);                                      \
+        return "fail: illegal write address";                                   \
+    }                                                                           \
+    if (op->stream < -1 || op->stream >= MAX_STREAMS) {                        \
+        STAT(s->logical_write_fail_sum++);                                      \
+        return "fail: illegal write stream";                                    \
+    }                                                                           \
+    s->write_stream = op->stream;                                               \
+    return WRITE(s, op->address, op->data);                                     \
+}                                                                               \
+                                                                                \
+static void replay_##name(SSD *s, TRACE *t, REPORT *r) {                        \
+    OP op;                                                                      \
+    int op_num = 0;                                                             \
+    for (int i = 0; next_op(t, &op); i++) {                                     \
+        if (op.op != 0) {                                                       \
+            PROF_BEGIN(s, PROF_DISPATCH);                                       \
+            char *rc = apply_cmd_##name(s, &op);                                \
+            PROF_END(s, PROF_DISPATCH);                                         \
+            PROF_BEGIN(s, PROF_OUTPUT);                                         \
+            report_cmd(stdout, op_num++, &op, rc, r);                           \
+            PROF_END(s, PROF_OUTPUT);                                           \
+        }                                                                       \
+        if (r->show_state) {                                                    \
+            PROF_BEGIN(s, PROF_OUTPUT);                                         \
+            printf("\n");                                                       \
+            dump(s);                                                            \
+            printf("\n");                                                       \
+            PROF_END(s, PROF_OUTPUT);                                           \
+        }                                                                       \
+        PROF_BEGIN(s, PROF_UPKEEP);                                             \
+        UPKEEP(s);                                                              \
+        PROF_END(s, PROF_UPKEEP);                                               \
+        if (s->checkpoint_interval > 0 &&                                       \
+            (i + 1) % s->checkpoint_interval == 0) {                            \
+            checkpoint_map(s);                                                  \
+        }                                                                       \
+    }                                                                           \
+}                                                                               \
+                                                                                \
+static void *shard_worker_##name(void *arg) {                                   \
+    SHARD *sh = (SHARD *)arg;                                                   \
+    OP op;                                                                      \
+    while (1) {                                                                 \
+        ring_pop(&sh->ring, &op);                                               \
+        if (op.op == 'q') {                                                     \
+            break;                                                              \
+        }                                                                       \
+        OP local = op;                                                          \
+        local.address = shard_address(sh, op.address);                          \
+        PROF_BEGIN(&sh->ssd, PROF_DISPATCH);                                    \
+        char *rc = apply_cmd_##name(&sh->ssd, &local);                          \
+        PROF_END(&sh->ssd, PROF_DISPATCH);                                      \
+        if (sh->out != NULL) {                                                  \
+            PROF_BEGIN(&sh->ssd, PROF_OUTPUT);                                  \
+            report_cmd(sh->out, op.index, &op, rc, &sh->report);                \
+            PROF_END(&sh->ssd, PROF_OUTPUT);                                    \
+        }                                                                       \
+        PROF_BEGIN(&sh->ssd, PROF_UPKEEP);                                      \
+        UPKEEP(&sh->ssd);                                                       \
+        PROF_END(&sh->ssd, PROF_UPKEEP);                                        \
+    }                                                                           \
+    return NULL;                                                                \
+}
+
+#define FTL_ENTRY(type, name) \
+    { type, #name, replay_##name, shard_worker_##name }
+
+// direct and ideal never open log blocks, so they have nothing to collect
+DEFINE_FTL(direct, write_direct, upkeep_none)
+DEFINE_FTL(log, write_log, upkeep)
+DEFINE_FTL(ideal, write_ideal, upkeep_none)
+DEFINE_FTL(zns, write_zoned, upkeep_zoned)
+
+const FTL ftl_table[] = {
+    FTL_ENTRY(TYPE_DIRECT, direct),
+    FTL_ENTRY(TYPE_LOGGING, log),
+    FTL_ENTRY(TYPE_IDEAL, ideal),
+    FTL_ENTRY(TYPE_ZONED, zns),
+};
+
+#define NUM_FTLS ((int)(sizeof(ftl_table) / sizeof(ftl_table[0])))
+
+const FTL *ftl_by_type(int type) {
+    for (int i = 0; i < NUM_FTLS; i++) {
+        if (ftl_table[i].type == type) {
+            return &ftl_table[i];
+        }
     }
-    printf("\n");
+    return NULL;
+}
 
-    // Blocks
-    printf("Block ");
-    for (int i = 0; i < s->num_blocks; i++) {
-        printf("%d", i);
-        for (int j = 0; j < s->pages_per_block - 1; j++) {
-            printf(" ");
+const FTL *ftl_by_name(const char *name) {
+    for (int i = 0; i < NUM_FTLS; i++) {
+        if (strcmp(ftl_table[i].name, name) == 0) {
+            return &ftl_table[i];
         }
-        printf(" ");
     }
-    printf("\n");
+    return NULL;
+}
 
-    // Pages
-    int max_len = snprintf(NULL, 0, "%d", s->num_pages - 1);
-    for (int n = max_len; n > 0; n--) {
-        if (n == max_len) {
-            printf("Page  ");
-        } else {
-            printf("      ");
+
+/*
+    Sharded Simulation
+
+    The dispatcher (main thread) pulls commands from the trace and routes
+    each to the shard owning its logical address through a single-producer/
+    single-consumer ring, so no locks are taken on the hot path. Each worker
+    applies its commands, runs its own upkeep and spools its own command
+    reports; once all workers are joined the shards are merged back into one
+    device for dump() and stats(), and the reports are printed shard by shard.
+*/
+
+// shard-local address; anything outside the shard's slice becomes -1, which the FTL rejects
+int shard_address(SHARD *sh, int address) {
+    long local = (long)address - sh->lba_offset;
+    return (local >= 0 && local < sh->ssd.num_logical_pages) ? (int)local : -1;
+}
+
+// slots are published in batches, so the shared indices change hands once per batch
+void ring_publish(RING *r) {
+    atomic_store_explicit(&r->tail, r->fill, memory_order_release);
+}
+
+void ring_push(RING *r, OP *op) {
+    if (r->fill - r->head_seen == RING_SIZE) {
+        ring_publish(r);
+        while (r->fill - (r->head_seen = atomic_load_explicit(&r->head, memory_order_acquire)) == RING_SIZE) {
+            sched_yield();
         }
-        for (int i = 0; i < s->num_pages; i++) {
-            char buf[10];
-            snprintf(buf, sizeof(buf), "%0*d", max_len, i);
-            printf("%c", buf[max_len - n]);
-            if (i > 0 && (i + 1) % 10 == 0) {
-                printf(" ");
+    }
+    r->slots[r->fill % RING_SIZE] = *op;
+    r->fill++;
+    if (r->fill % RING_BATCH == 0) {
+        ring_publish(r);
+    }
+}
+
+void ring_pop(RING *r, OP *op) {
+    unsigned int head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    while (r->tail_seen == head) {
+        r->tail_seen = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (r->tail_seen == head) {
+            sched_yield();
+        }
+    }
+    *op = r->slots[head % RING_SIZE];
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+void merge_shards(SSD *s, SHARD *shards, int num_shards) {
+    for (int k = 0; k < num_shards; k++) {
+        SSD *t = &shards[k].ssd;
+        int block_offset = shards[k].block_offset;
+        int page_offset = block_offset * s->pages_per_block;
+        int lba_offset = shards[k].lba_offset;
+
+        for (int b = 0; b < t->num_blocks; b++) {
+            s->gc_used_blocks[block_offset + b] = t->gc_used_blocks[b];
+            s->live_count[block_offset + b] = t->live_count[b];
+            s->physical_erase_count[block_offset + b] = t->physical_erase_count[b];
+            s->physical_read_count[block_offset + b] = t->physical_read_count[b];
+            s->physical_write_count[block_offset + b] = t->physical_write_count[b];
+            s->disturb_read_count[block_offset + b] = t->disturb_read_count[b];
+            s->program_stamp[block_offset + b] = t->program_stamp[b];
+            s->reclaim_pending[block_offset + b] = t->reclaim_pending[b];
+        }
+
+        for (int p = 0; p < t->num_pages; p++) {
+            int logical_page = rmap_get(t, p);
+            s->state[page_offset + p] = t->state[p];
+            s->data[page_offset + p] = t->data[p];
+            s->page_stream[page_offset + p] = t->page_stream[p];
+            rmap_set(s, page_offset + p, (logical_page == -1) ? -1 : logical_page + lba_offset);
+        }
+
+        for (int l = fmap_next(t, 0); l != -1; l = fmap_next(t, l + 1)) {
+            fmap_set(s, lba_offset + l, fmap_get(t, l) + page_offset);
+        }
+
+        s->gc_count += t->gc_count;
+        s->physical_erase_sum += t->physical_erase_sum;
+        s->physical_write_sum += t->physical_write_sum;
+        s->physical_read_sum += t->physical_read_sum;
+        s->logical_trim_sum += t->logical_trim_sum;
+        s->logical_write_sum += t->logical_write_sum;
+        s->logical_read_sum += t->logical_read_sum;
+        s->logical_trim_fail_sum += t->logical_trim_fail_sum;
+        s->logical_write_fail_sum += t->logical_write_fail_sum;
+        s->logical_read_fail_sum += t->logical_read_fail_sum;
+        s->gc_read_sum += t->gc_read_sum;
+        s->gc_write_sum += t->gc_write_sum;
+        s->copyback_sum += t->copyback_sum;
+        s->copyback_time_sum += t->copyback_time_sum;
+        s->read_retry_sum += t->read_retry_sum;
+        s->read_reclaim_sum += t->read_reclaim_sum;
+        s->slc_write_sum += t->slc_write_sum;
+        s->dense_write_sum += t->dense_write_sum;
+        s->fold_page_sum += t->fold_page_sum;
+        s->fold_block_sum += t->fold_block_sum;
+        for (int i = 0; i < MAX_STREAMS; i++) {
+            s->stream_host_writes[i] += t->stream_host_writes[i];
+            s->stream_gc_writes[i] += t->stream_gc_writes[i];
+        }
+
+        // shard phases overlap in time, so their sum can exceed the wall clock
+        for (int i = 0; i < PROF_PHASES; i++) {
+            s->prof_ns[i] += t->prof_ns[i];
+            s->prof_calls[i] += t->prof_calls[i];
+        }
+        s->erase_time_sum += t->erase_time_sum;
+        s->write_time_sum += t->write_time_sum;
+        s->read_time_sum += t->read_time_sum;
+
+        // phase timelines are per shard; only the region totals merge
+        s->region_time[0] += t->region_time[0];
+        s->region_time[1] += t->region_time[1];
+        if (t->num_phases > 0) {
+            s->region_time[t->phase_slc] += busy_time(t) - t->phase_start;
+        }
+        if (t->op_clock > s->op_clock) {
+            s->op_clock = t->op_clock;
+        }
+    }
+}
+
+void run_sharded(SSD *s, TRACE *t, int num_shards, REPORT *r) {
+    SHARD *shards = calloc(num_shards, sizeof(SHARD));
+    if (shards == NULL) {
+        printf("out of memory for %d shards\n", num_shards);
+        exit(1);
+    }
+
+    // split blocks evenly across channels; logical space follows proportionally
+    int block_offset = 0;
+    for (int k = 0; k < num_shards; k++) {
+        SHARD *sh = &shards[k];
+        int nb = s->num_blocks / num_shards + (k < s->num_blocks % num_shards);
+        int lba_end = (int)((long)s->num_logical_pages * (block_offset + nb) / s->num_blocks);
+        sh->block_offset = block_offset;
+        sh->lba_offset = (int)((long)s->num_logical_pages * block_offset / s->num_blocks);
+        sh->report = *r;
+        if (r->show_cmds || r->quiz_cmds) {
+            sh->out = tmpfile();
+            if (sh->out == NULL) {
+                printf("failed to spool reports for shard %d\n", k);
+                exit(1);
             }
         }
-        printf("\n");
+        atomic_init(&sh->ring.head, 0);
+        atomic_init(&sh->ring.tail, 0);
+
+        // water marks scale down with the shard. For the log FTL, GC must be able to
+        // bring the shard's live data under the low mark, and the dense blocks above
+        // it must hold an open block per host stream plus the one GC keeps in reserve
+        int high = s->gc_high_water_mark * nb / s->num_blocks;
+        int low = s->gc_low_water_mark * nb / s->num_blocks;
+        int slc_blocks = s->slc_blocks * nb / s->num_blocks;
+        int lba_count = lba_end - sh->lba_offset;
+        int spare = nb - slc_blocks - low;
+        if (s->ssd_type == TYPE_LOGGING &&
+            (low < 1 || high < low || lba_count > low * s->pages_per_block ||
+             spare < 2 + (s->hot_threshold > 0))) {
+            printf("shard %d too small for its water marks (%d blocks, %d logical pages, marks %d/%d)\n",
+                   k, nb, lba_count, high, low);
+            exit(1);
+        }
+
+        // gc tracing and state dumps would interleave across threads, so shards run quiet
+        initialize_ssd(&sh->ssd, s->ssd_type, lba_count, nb, s->pages_per_block,
+                       s->block_erase_time, s->page_program_time, s->page_read_time,
+                       high, low, 0, 0);
+        configure_read_disturb(&sh->ssd, s->read_disturb_threshold, s->read_retry_time,
+                               s->retention_limit);
+        configure_slc(&sh->ssd, slc_blocks, s->slc_erase_time,
+                      s->slc_program_time, s->slc_read_time);
+        configure_copyback(&sh->ssd, s->copyback_time);
+        configure_streams(&sh->ssd, s->hot_threshold, s->heat_region_bits);
+        if (s->sparse_map) {
+            configure_sparse_map(&sh->ssd);
+        }
+        block_offset += nb;
     }
 
-    // State
-    printf("State ");
-    for (int i = 0; i < s->num_pages; i++) {
-        printf("%c", printable_state(s->state[i]));
-        if (i > 0 && (i + 1) % 10 == 0) {
-            printf(" ");
+    const FTL *ftl = ftl_by_type(s->ssd_type);
+    for (int k = 0; k < num_shards; k++) {
+        if (pthread_create(&shards[k].thread, NULL, ftl->shard_worker, &shards[k]) != 0) {
+            printf("failed to start shard %d\n", k);
+            exit(1);
         }
     }
-    printf("\n");
 
-    // Data
-    printf("Data  ");
-    for (int i = 0; i < s->num_pages; i++) {
-        if (s->state[i] == STATE_VALID) {
-            printf("%c", s->data[i]);
-        } else {
-            printf(" ");
+    // route each command to the shard owning its logical address; addresses
+    // out of range everywhere go to shard 0, which rejects and counts them
+    OP op;
+    int op_num = 0;
+    while (next_op(t, &op)) {
+        int k = 0;
+        if (op.op == 0) {
+            continue;
         }
-        if (i > 0 && (i + 1) % 10 == 0) {
-            printf(" ");
+        op.index = op_num++;
+        if (op.address >= 0 && op.address < s->num_logical_pages) {
+            while (k < num_shards - 1 && op.address >= shards[k + 1].lba_offset) {
+                k++;
+            }
         }
+        ring_push(&shards[k].ring, &op);
     }
-    printf("\n");
 
-    // Live
-    printf("Live  ");
-    for (int i = 0; i < s->num_pages; i++) {
-        if (s->state[i] == STATE_VALID && s->forward_map[s->reverse_map[i]] == i) {
-            printf("+");
-        } else {
-            printf(" ");
+    for (int k = 0; k < num_shards; k++) {
+        OP stop = { .index = -1, .op = 'q', .address = 0, .data = ' ', .stream = -1 };
+        ring_push(&shards[k].ring, &stop);
+        ring_publish(&shards[k].ring);
+    }
+    for (int k = 0; k < num_shards; k++) {
+        pthread_join(shards[k].thread, NULL);
+    }
+
+    merge_shards(s, shards, num_shards);
+
+    // each shard's reports are in command order; shards follow one another
+    PROF_BEGIN(s, PROF_OUTPUT);
+    for (int k = 0; k < num_shards; k++) {
+        if (shards[k].out == NULL) {
+            continue;
         }
-        if (i > 0 && (i + 1) % 10 == 0) {
-            printf(" ");
+        printf("shard %d (logical pages %d-%d):\n", k, shards[k].lba_offset,
+               shards[k].lba_offset + shards[k].ssd.num_logical_pages - 1);
+        rewind(shards[k].out);
+        char buf[4096];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), shards[k].out)) > 0) {
+            fwrite(buf, 1, n, stdout);
         }
+        fclose(shards[k].out);
     }
-    printf("\n");
+    PROF_END(s, PROF_OUTPUT);
+
+    for (int k = 0; k < num_shards; k++) {
+        free_sparse_map(&shards[k].ssd);
+    }
+    free(shards);
 }
 
 
@@ -607,9 +2981,21 @@ int main(int argc, char *argv[]) {
     int quiz_cmds = 0;
     int show_stats = 0;
     int solve = 0;
+    int num_shards = 1;
+    int read_disturb = 0;
+    int retry_time = 20;
+    int retention = 0;
+    char slc[100] = "";
+    int copyback_time = 0;
+    char zones[100] = "1/0";
+    int sparse_map = 0;
+    int crash_after = 0;
+    int checkpoint_interval = 0;
+    int mount_channels = 1;
+    char hot_cold[100] = "";
 
     int opt;
-    while ((opt = getopt(argc, argv, "s:n:P:K:k:r:L:T:l:B:p:G:g:R:W:E:JFCqSc")) != -1) {
+    while ((opt = getopt(argc, argv, "s:n:P:K:k:r:L:T:l:B:p:G:g:R:W:E:j:D:d:X:Z:o:z:mx:b:t:A:JFCqSc")) != -1) {
         switch (opt) {
             case 's':
                 seed = atoi(optarg);
@@ -659,6 +3045,42 @@ int main(int argc, char *argv[]) {
             case 'E':
                 erase_time = atoi(optarg);
                 break;
+            case 'j':
+                num_shards = atoi(optarg);
+                break;
+            case 'D':
+                read_disturb = atoi(optarg);
+                break;
+            case 'd':
+                retry_time = atoi(optarg);
+                break;
+            case 'X':
+                retention = atoi(optarg);
+                break;
+            case 'Z':
+                strncpy(slc, optarg, sizeof(slc) - 1);
+                break;
+            case 'o':
+                copyback_time = atoi(optarg);
+                break;
+            case 'z':
+                strncpy(zones, optarg, sizeof(zones) - 1);
+                break;
+            case 'm':
+                sparse_map = 1;
+                break;
+            case 'x':
+                crash_after = atoi(optarg);
+                break;
+            case 'b':
+                checkpoint_interval = atoi(optarg);
+                break;
+            case 't':
+                mount_channels = atoi(optarg);
+                break;
+            case 'A':
+                strncpy(hot_cold, optarg, sizeof(hot_cold) - 1);
+                break;
             case 'J':
                 show_gc = 1;
                 break;
@@ -708,180 +3130,173 @@ int main(int argc, char *argv[]) {
     printf("ARG quiz_cmds %d\n", quiz_cmds);
     printf("ARG show_stats %d\n", show_stats);
     printf("ARG compute %d\n", solve);
+    printf("ARG shards %d\n", num_shards);
+    printf("ARG read_disturb %d\n", read_disturb);
+    printf("ARG retry_time %d\n", retry_time);
+    printf("ARG retention %d\n", retention);
+    printf("ARG slc %s\n", slc);
+    printf("ARG copyback_time %d\n", copyback_time);
+    printf("ARG zones %s\n", zones);
+    printf("ARG sparse_map %d\n", sparse_map);
+    printf("ARG crash_after %d\n", crash_after);
+    printf("ARG checkpoint_interval %d\n", checkpoint_interval);
+    printf("ARG mount_channels %d\n", mount_channels);
+    printf("ARG hot_cold %s\n", hot_cold);
     printf("\n");
 
 
     // Initialize SSD object 
 
     SSD s;
-    int ssd_type;
-    if (strcmp(ssd_type_str, "direct") == 0) {
-        ssd_type = TYPE_DIRECT;
-    } else if (strcmp(ssd_type_str, "log") == 0) {
-        ssd_type = TYPE_LOGGING;
-    } else if (strcmp(ssd_type_str, "ideal") == 0) {
-        ssd_type = TYPE_IDEAL;
-    } else {
+    const FTL *ftl = ftl_by_name(ssd_type_str);
+    if (ftl == NULL) {
         printf("bad SSD type (%s)\n", ssd_type_str);
         exit(1);
     }
+    if (!sparse_map && num_logical_pages > MAX_PAGES) {
+        printf("logical space too large for the dense map (%d > %d), use -m\n",
+               num_logical_pages, MAX_PAGES);
+        exit(1);
+    }
+    if (sparse_map && (ftl->type == TYPE_DIRECT || ftl->type == TYPE_IDEAL)) {
+        printf("sparse map requires a mapping FTL (log or zns)\n");
+        exit(1);
+    }
+    if (num_shards < 1 || num_shards > MAX_SHARDS || num_shards > num_blocks) {
+        printf("bad shard count (%d)\n", num_shards);
+        exit(1);
+    }
+
+    if (num_cmds < 0) {
+        printf("bad command count (%d)\n", num_cmds);
+        exit(1);
+    }
 
-    initialize_ssd(&s, ssd_type, num_logical_pages, num_blocks, pages_per_block,
+    initialize_ssd(&s, ftl->type, num_logical_pages, num_blocks, pages_per_block,
                    (float)erase_time, (float)program_time, (float)read_time,
                    high_water_mark, low_water_mark, show_gc, show_state);
-
-
-    // generate cmds (if not passed in by cmd_list)
-
-    srand(seed);
-    
-    char cmds[1000][100];
-    int cmd_count = 0;
-
-    if (strlen(cmd_list) == 0) {
-        int max_page_addr = num_logical_pages;
-        int percent_reads, percent_writes, percent_trims;
-        sscanf(op_percentages, "%d/%d/%d", &percent_reads, &percent_writes, &percent_trims);
-
-        if (percent_writes <= 0) {
-            printf("must have some writes, otherwise nothing in the SSD!\n");
+    if (sparse_map) {
+        configure_sparse_map(&s);
+    }
+    configure_read_disturb(&s, read_disturb, (float)retry_time, retention);
+    configure_copyback(&s, (float)copyback_time);
+
+    // power-loss recovery: map checkpoint interval (0 for none) / mount scan threads
+    if (checkpoint_interval < 0 || mount_channels < 1 || mount_channels > MAX_SHARDS ||
+        mount_channels > num_blocks) {
+        printf("bad recovery configuration (checkpoint %d, channels %d)\n",
+               checkpoint_interval, mount_channels);
+        exit(1);
+    }
+    configure_recovery(&s, checkpoint_interval, mount_channels);
+
+    // hot/cold classifier: writes per region to count as hot / log2 of the region size
+    if (strlen(hot_cold) > 0) {
+        int hot_threshold = 0, region_bits = 0;
+        sscanf(hot_cold, "%d/%d", &hot_threshold, &region_bits);
+        if (hot_threshold < 1 || region_bits < 0 || region_bits > 30) {
+            printf("bad hot/cold configuration (%s)\n", hot_cold);
             exit(1);
         }
+        if (ftl->type != TYPE_LOGGING) {
+            printf("hot/cold separation requires the log FTL\n");
+            exit(1);
+        }
+        configure_streams(&s, hot_threshold, region_bits);
+    }
 
-        char printable[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
-        int valid_addresses[MAX_PAGES];
-        int valid_address_count = 0;
-        int total_percent = percent_reads + percent_writes + percent_trims;
-
-        for (int i = 0; i < num_cmds; i++) {
-            int which_cmd = rand() % total_percent;
-            if (which_cmd < percent_reads) {
-
-                // read
-                int address;
-                if (rand() % 100 < read_fail) {
-                    address = rand() % max_page_addr;
-                } else {
-                    if (valid_address_count < 2) {
-                        i--;
-                        continue;
-                    }
-                    address = valid_addresses[rand() % valid_address_count];
-                }
-                sprintf(cmds[cmd_count++], "r%d", address);
-            } else if (which_cmd < percent_reads + percent_writes) {
-
-                // write
-                int address;
-                if (skew_start == 0 && strlen(skew) > 0 && ((float)rand() / RAND_MAX) < (atoi(strtok(skew, "/")) / 100.0)) {
-                    address = rand() % (int)(atoi(strtok(NULL, "/")) / 100.0 * (max_page_addr - 1));
-                } else {
-                    address = rand() % max_page_addr;
-                }
-                int found = 0;
-                for (int j = 0; j < valid_address_count; j++) {
-                    if (valid_addresses[j] == address) {
-                        found = 1;
-                        break;
-                    }
-                }
-                if (!found) {
-                    valid_addresses[valid_address_count++] = address;
-                }
-                char data = printable[rand() % strlen(printable)];
-                sprintf(cmds[cmd_count++], "w%d:%c", address, data);
-                if (skew_start > 0) {
-                    skew_start--;
-                }
-            } else {
-
-                // trim
-                if (valid_address_count < 1) {
-                    i--;
-                    continue;
-                }
-                int idx = rand() % valid_address_count;
-                int address = valid_addresses[idx];
-                sprintf(cmds[cmd_count++], "t%d", address);
+    // zoned device: blocks per zone / max open zones (0 for no limit)
+    if (ftl->type == TYPE_ZONED) {
+        int zone_blocks = 1, max_open_zones = 0;
+        sscanf(zones, "%d/%d", &zone_blocks, &max_open_zones);
+        if (zone_blocks < 1 || zone_blocks > num_blocks || max_open_zones < 0) {
+            printf("bad zone configuration (%s)\n", zones);
+            exit(1);
+        }
+        if (num_shards > 1) {
+            printf("zoned devices cannot be sharded\n");
+            exit(1);
+        }
+        configure_zones(&s, zone_blocks, max_open_zones);
+    }
 
-                for (int j = idx; j < valid_address_count - 1; j++) {
-                    valid_addresses[j] = valid_addresses[j + 1];
-                }
-                valid_address_count--;
-            }
+    // pSLC region: blocks/program/read/erase, times default to the dense ones
+    if (strlen(slc) > 0) {
+        int slc_blocks = 0;
+        int slc_program = program_time, slc_read = read_time, slc_erase = erase_time;
+        sscanf(slc, "%d/%d/%d/%d", &slc_blocks, &slc_program, &slc_read, &slc_erase);
+        if (slc_blocks < 0 || slc_blocks >= num_blocks) {
+            printf("bad pSLC block count (%d)\n", slc_blocks);
+            exit(1);
         }
-    } else {
-        char *token = strtok(cmd_list, ",");
-        while (token != NULL) {
-            strcpy(cmds[cmd_count++], token);
-            token = strtok(NULL, ",");
+        if (slc_blocks > 0 && ftl->type != TYPE_LOGGING) {
+            printf("pSLC cache requires the log FTL\n");
+            exit(1);
         }
+        configure_slc(&s, slc_blocks, (float)slc_erase, (float)slc_program, (float)slc_read);
     }
 
+
+    // generate cmds (if not passed in by cmd_list); both are streamed, one
+    // command at a time, as the trace is replayed
+
+    TRACE trace;
+    initialize_trace(&trace, seed, cmd_list, op_percentages, skew, skew_start, read_fail,
+                     num_cmds, num_logical_pages);
+
     dump(&s);
     printf("\n");
 
-    int op = 0;
-    for (int i = 0; i < cmd_count; i++) {
-        char *cmd = cmds[i];
-        if (strlen(cmd) == 0) {
-            break;
+    // inject a power loss after the given command
+    if (crash_after != 0) {
+        if (crash_after < 0 || crash_after > trace.cmd_total) {
+            printf("bad crash point (%d)\n", crash_after);
+            exit(1);
         }
-        if (cmd[0] == 'r') {
+        trace.crash_after = crash_after;
+    }
+    if (num_shards > 1 && (crash_after != 0 || trace.has_power_loss || checkpoint_interval > 0)) {
+        printf("power loss cannot be simulated on a sharded device\n");
+        exit(1);
+    }
 
-            // read
-            int address = atoi(cmd + 1);
-            char *data = read_ssd(&s, address);
-            if (show_cmds || (quiz_cmds && solve)) {
-                printf("cmd %3d:: read(%d) -> %s\n", op, address, data);
-            } else if (quiz_cmds) {
-                printf("cmd %3d:: read(%d) -> ??\n", op, address);
-            }
-            op++;
-        } else if (cmd[0] == 'w') {
+    REPORT report = { show_cmds, quiz_cmds, solve, show_state };
+#if SSD_PROFILE
+    long start_ns = prof_now();
+#endif
 
-            // write
-            char *colon = strchr(cmd, ':');
-            int address = atoi(cmd + 1);
-            char data = colon[1];
-            char *rc = write_ssd(&s, address, data);
-            if (show_cmds || (quiz_cmds && solve)) {
-                printf("cmd %3d:: write(%d, %c) -> %s\n", op, address, data, rc);
-            } else if (quiz_cmds) {
-                printf("cmd %3d:: command(??) -> ??\n", op);
-            }
-            op++;
-        } else if (cmd[0] == 't') {
+    if (num_shards > 1) {
 
-            // trim
-            int address = atoi(cmd + 1);
-            char *rc = trim(&s, address);
-            if (show_cmds || (quiz_cmds && solve)) {
-                printf("cmd %3d:: trim(%d) -> %s\n", op, address, rc);
-            } else if (quiz_cmds) {
-                printf("cmd %3d:: command(??) -> ??\n", op);
-            }
-            op++;
-        }
+        // parallel engine: each shard reports its own commands once the run ends
+        run_sharded(&s, &trace, num_shards, &report);
+        PROF_BEGIN(&s, PROF_OUTPUT);
+        printf("\n");
+        dump(&s);
+        PROF_END(&s, PROF_OUTPUT);
+    } else {
+        ftl->replay(&s, &trace, &report);
 
-        if (show_state) {
+        if (!show_state) {
+            PROF_BEGIN(&s, PROF_OUTPUT);
             printf("\n");
             dump(&s);
-            printf("\n");
+            PROF_END(&s, PROF_OUTPUT);
         }
-
-        upkeep(&s);
-    }
-
-    if (!show_state) {
-        printf("\n");
-        dump(&s);
     }
     printf("\n");
     if (show_stats) {
+        PROF_BEGIN(&s, PROF_OUTPUT);
         stats(&s);
         printf("\n");
+        PROF_END(&s, PROF_OUTPUT);
     }
+#if SSD_PROFILE
+    profile_report(&s, prof_now() - start_ns);
+    printf("\n");
+#endif
 
+    free_trace(&trace);
+    free_sparse_map(&s);
+    free_checkpoint(&s);
     return 0;
 }